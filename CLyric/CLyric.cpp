@@ -5,141 +5,64 @@
 
 #include "CLyric.h"
 #include "CLyricUtils.h"
+#include "CLyricParser.h"
+#include "CLyricBinary.h"
 
 #include <cctype>
 #include <sstream>
+#include <charconv>
 #include <fstream>
 #include <filesystem>
-#include <map>
 #include <utility>
 #include <algorithm>
 
 using namespace cLyric;
 
+void CLyricTimecodes::decode() const {
+    timecodeValues.clear();
+    parseTimecodes(raw, timecodeValues);
+    decoded = true;
+}
+
+void CLyricTimecodes::appendRaw(std::string_view payload) {
+    // A payload without well-formed pairs is dropped, so empty never has to decode
+    if (!hasTimecodes(payload))
+        return;
+    if (empty()) {
+        raw = payload;
+        decoded = false;
+    } else {
+        parseTimecodes(payload, edit());
+    }
+}
+
+std::vector<CLyricTimecodes::value_type> &CLyricTimecodes::edit() {
+    if (!decoded)
+        decode();
+    raw.clear();
+    return timecodeValues;
+}
+
 CLyricItem::CLyricItem(const std::vector<std::string> &lyricLines, LyricStyle style) {
+    CLyricLineTokens tokens;
     for (const std::string &lyricLine : lyricLines) {
-        std::regex linePattern(R"((\[.*?\])+(.*))");
-        std::regex timeTagPattern(R"(\[(\d{2})?:?(\d{2,3}):(\d{2})\.?(\d{1,3})?\])");
-        std::regex wordTagPattern(R"(\[(\w+)\])");
+        tokenizeLyricLine(lyricLine, tokens);
 
-        std::string lineContent;
-        std::smatch lineMatch;
-        if (std::regex_match(lyricLine, lineMatch, linePattern)) {
-            lineContent = lineMatch.str(2);
-        } else continue;
+        if (!tokens.hasLeadingTags)
+            continue;
+        std::string_view lineContent = tokens.content;
 
-        std::smatch timeTagMatch;
         if (style != LyricStyle::KugouStyle) {
-            if (std::regex_search(lyricLine, timeTagMatch, timeTagPattern)) {
-                int hourTime = 0;
-                try {
-                    hourTime = std::stoi(timeTagMatch.str(1));
-                } catch (std::invalid_argument &e) {}
-                int minuteTime = std::stoi(timeTagMatch.str(2));
-                int secondTime = std::stoi(timeTagMatch.str(3));
-                int millisecondTime = 0;
-                const std::string &millisecondString = timeTagMatch.str(4);
-                try {
-                    millisecondTime = std::stoi(millisecondString);
-                } catch (std::invalid_argument &e) {}
-
-                switch (millisecondString.length()) {
-                    case 1:
-                        millisecondTime *= 100;
-                        break;
-                    case 2:
-                        millisecondTime *= 10;
-                        break;
-                    default:;
-                }
-
-                startTime = hourTime * 60 * 60 * 1000 + minuteTime * 60 * 1000 + secondTime * 1000 + millisecondTime;
-
-                if (secondTime >= 60) { // some mm:ss:ms format
-                    startTime += secondTime;
-                }
-
+            if (tokens.hasTimeTag) {
+                startTime = tokens.time;
             } else continue;
         } else {
-            std::regex KugouTimeTagPattern(R"(\[(\d+?),(\d+?)\])");
-            std::smatch KugouTimeTagMatch;
-            if (std::regex_search(lyricLine, KugouTimeTagMatch, KugouTimeTagPattern)) {
-                startTime = std::stoi(KugouTimeTagMatch.str(1));
+            if (tokens.hasKugouTimeTag) {
+                startTime = tokens.kugouTime;
             } else continue;
         }
 
-        std::smatch wordTagMatch;
-        if (std::regex_search(lyricLine, wordTagMatch, wordTagPattern)) {
-            if (wordTagMatch.str(1) == "tr") {
-                translation = lineContent;
-            } else if (wordTagMatch.str(1) == "tc") {
-                std::vector<std::string> lineTimeCodes = split_string(lineContent, "|");
-                for (const std::string &timecode : lineTimeCodes) {
-                    std::vector<std::string> codes = split_string(timecode, ",");
-                    timecodes.emplace_back(std::stoi(codes[0]), std::stoi(codes[1]));
-                }
-            }
-        } else if (style == LyricStyle::XiamiStyle) {
-            std::regex timeCodePairRegex(R"((\d+)>(.*?)<)");
-            std::regex lastPairRegex(R"(^.*<(\d+)>(.*?)$)");
-
-            std::smatch lastPairMatch;
-            if (std::regex_match(lineContent, lastPairMatch, lastPairRegex)) {
-                int lastTimeCode = std::stoi(lastPairMatch.str(1));
-                std::string lastWord = lastPairMatch.str(2);
-
-                int totalTime = 0, charNum = 0; // Number of character "char", not the byte "char"
-                timecodes.emplace_back(totalTime, charNum);
-                content.clear();
-                std::smatch timeCodePairMatch;
-                while (std::regex_search(lineContent, timeCodePairMatch, timeCodePairRegex)) {
-                    std::string word = timeCodePairMatch.str(2);
-                    totalTime += std::stoi(timeCodePairMatch.str(1));
-                    charNum += utf8StringChars(word);
-                    timecodes.emplace_back(totalTime, charNum);
-                    content.append(word);
-                    lineContent = timeCodePairMatch.suffix();
-                }
-
-                totalTime += lastTimeCode;
-                charNum += utf8StringChars(lastWord);
-                timecodes.emplace_back(totalTime, charNum);
-                content.append(lastWord);
-            }
-        } else if (style == LyricStyle::KugouStyle) {
-            std::regex timeCodePairRegex(R"((\d+?),(\d+?),\d+?>(.*?)<)");
-            std::regex lastPairRegex(R"(.*<(\d+?),(\d+?),\d+?>(.*?)$)");
-
-            std::smatch lastPairMatch;
-            if (std::regex_match(lineContent, lastPairMatch, lastPairRegex)) {
-                int lastTimeCodeStart = std::stoi(lastPairMatch.str(1));
-                int lastTimeCodeLength = std::stoi(lastPairMatch.str(2));
-                std::string lastWord = lastPairMatch.str(3);
-
-                int totalTime = 0, charNum = 0; // Number of character "char", not the byte "char"
-                timecodes.emplace_back(totalTime, charNum);
-                content.clear();
-                std::smatch timeCodePairMatch;
-                while (std::regex_search(lineContent, timeCodePairMatch, timeCodePairRegex)) {
-                    std::string word = timeCodePairMatch.str(3);
-                    // totalTime = start + length;
-                    totalTime = std::stoi(timeCodePairMatch.str(1)) + std::stoi(timeCodePairMatch.str(2));
-                    charNum += utf8StringChars(word);
-                    timecodes.emplace_back(totalTime, charNum);
-                    content.append(word);
-                    lineContent = timeCodePairMatch.suffix();
-                }
-
-                totalTime = lastTimeCodeStart + lastTimeCodeLength;
-                charNum += utf8StringChars(lastWord);
-                timecodes.emplace_back(totalTime, charNum);
-                content.append(lastWord);
-            }
-        }
-
-        if (content.empty()) {
-            content = lineContent;
-        }
+        applyLyricLine(*this, lyricLineKind(tokens.wordTag), lineContent, style);
     }
 }
 
@@ -151,134 +74,105 @@ bool CLyricItem::operator>(const CLyricItem &item) const {
     return this->startTime > item.startTime;
 }
 
-std::string CLyricItem::fileSaveString() {
-    std::ostringstream stringStream;
-    stringStream << '[' << std::setw(2) << std::setfill('0') << startTime / 60000 << ':' << std::setw(2)
-                 << std::setfill('0') << startTime / 1000 % 60 << '.' << std::left << std::setw(3) << std::setfill('0')
-                 << startTime % 1000 << ']';
-    std::string timeTag = stringStream.str();
-    stringStream.str("");
-    stringStream.clear();
-    stringStream << timeTag << content << '\n';
-    if (!translation.empty()) {
-        stringStream << timeTag << "[tr]" << translation << '\n';
+namespace {
+
+    void appendInt(std::string &buffer, int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
     }
-    if (!timecodes.empty()) {
-        std::ostringstream timeCodeStringStream;
-        for (size_t i = 0; i < timecodes.size() - 1; ++i) {
-            timeCodeStringStream << timecodes[i].first << ',' << timecodes[i].second << '|';
-        }
-        timeCodeStringStream << timecodes.back().first << ',' << timecodes.back().second;
-        std::string timeCodeString = timeCodeStringStream.str();
-        stringStream << timeTag << "[tc]" << timeCodeString << '\n';
+
+    // Same output as iostream with setw(width) and setfill('0'), which pads the sign as well
+    void appendPaddedInt(std::string &buffer, int value, size_t width, bool leftAlign) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        auto length = static_cast<size_t>(result.ptr - digits);
+        if (!leftAlign && length < width)
+            buffer.append(width - length, '0');
+        buffer.append(digits, length);
+        if (leftAlign && length < width)
+            buffer.append(width - length, '0');
     }
-    return stringStream.str();
-}
 
-CLyric::CLyric(std::string lyricContent, LyricStyle style) {
-    while (lyricContent.find('\r') != std::string::npos) {
-        lyricContent.erase(lyricContent.find('\r'), 1);
+    // [mm:ss.xxx], milliseconds are left aligned as they have always been saved
+    void appendTimeTag(std::string &buffer, int time) {
+        buffer.push_back('[');
+        appendPaddedInt(buffer, time / 60000, 2, false);
+        buffer.push_back(':');
+        appendPaddedInt(buffer, time / 1000 % 60, 2, false);
+        buffer.push_back('.');
+        appendPaddedInt(buffer, time % 1000, 3, true);
+        buffer.push_back(']');
     }
 
-    std::vector<std::string> lines = split_string(lyricContent, "\n");
-    std::multimap<std::string, std::string> linesMap;
+    constexpr size_t timeTagSize = 11; // Room for [mm:ss.xxx] per line
 
-    for (size_t i = 0; i < lines.size(); ++i) {
-        std::string line = lines[i];
+}
 
-        std::regex linePattern(R"((\[.*?\])+(.*))");
-        std::smatch lineMatch;
-        std::string content;
-        if (line.size() > 400) {
-            continue;
-        }
-        if (std::regex_match(line, lineMatch, linePattern)) {
-            content = lineMatch.str(2);
-        }
+size_t CLyricItem::fileSaveSize() const {
+    size_t size = timeTagSize + content.size() + 1;
+    if (!translation.empty())
+        size += timeTagSize + 4 + translation.size() + 1;
+    if (!timecodes.rawPayload().empty()) {
+        size += timeTagSize + 4 + timecodes.rawPayload().size() + 1;
+    } else if (!timecodes.empty()) {
+        size += timeTagSize + 4 + timecodes.size() * 12;
+    }
+    return size;
+}
 
-        std::regex tagsPattern(R"(\[(.*?)\])");
-        std::smatch tagsMatch;
-        std::vector<std::string> tags;
-        while (std::regex_search(line, tagsMatch, tagsPattern)) {
-            tags.push_back(tagsMatch.str(1));
-            line = tagsMatch.suffix();
-        }
+void CLyricItem::appendFileSaveString(std::string &buffer) const {
+    size_t timeTagBegin = buffer.size();
+    appendTimeTag(buffer, startTime);
+    size_t timeTagLength = buffer.size() - timeTagBegin;
 
-        if (tags.size() == 1) {
-            const std::string &tag = tags[0];
-            if (std::isdigit(static_cast<unsigned char>(tag[0]))) { // Signed char UB
-                linesMap.insert(std::pair<std::string, std::string>(tag, "[" + tag + "]" + line));
-            } else {
-                if (tag == "ti") {
-                    track.title = content;
-                } else if (tag == "al") {
-                    track.album = content;
-                } else if (tag == "ar") {
-                    track.artist = content;
-                } else if (tag == "du") {
-                    track.duration = std::stoi(content);
-                } else if (tag == "offset") {
-                    offset = std::stoi(content);
-                } else if (tag == "instrumental") {
-                    track.instrumental = true;
-                } else if (style == LyricStyle::XiamiStyle && tag == "x-trans") {
-                    std::string previousLine = lines[i - 1];
-
-                    std::string previousContent;
-                    if (std::regex_match(previousLine, lineMatch, linePattern)) {
-                        previousContent = lineMatch.str(2);
-                    }
-
-                    std::vector<std::string> previousTags;
-                    while (std::regex_search(previousLine, tagsMatch, tagsPattern)) {
-                        previousTags.push_back(tagsMatch.str(1));
-                        previousLine = tagsMatch.suffix();
-                    }
-
-                    if (content.empty()) { // Empty trans
-                        content = previousContent;
-                    }
-
-                    for (const std::string &previousTag: previousTags) {
-                        if (std::isdigit(static_cast<unsigned char>(previousTag[0])))
-                            linesMap.insert(
-                                    std::pair<std::string, std::string>(previousTag,
-                                                                        "[" + previousTag + "]" + "[tr]" + content));
-                    }
-                }
-            }
+    buffer.append(content);
+    buffer.push_back('\n');
+    if (!translation.empty()) {
+        buffer.append(buffer, timeTagBegin, timeTagLength);
+        buffer.append("[tr]");
+        buffer.append(translation);
+        buffer.push_back('\n');
+    }
+    if (!timecodes.empty()) {
+        buffer.append(buffer, timeTagBegin, timeTagLength);
+        buffer.append("[tc]");
+        if (!timecodes.rawPayload().empty()) {
+            // Written back as read, without decoding
+            buffer.append(timecodes.rawPayload());
         } else {
-            for (auto &tag: tags) {
-                if (!std::isdigit(static_cast<unsigned char>(tag[0]))) {
-                    std::string prepend = "[";
-                    prepend.append(tag).append("]").append(content);
-                    content = prepend;
-                }
-            }
-            for (auto &tag: tags) {
-                if (std::isdigit(static_cast<unsigned char>(tag[0]))) {
-                    std::ostringstream lineStream;
-                    lineStream << "[" << tag << "]" << content;
-                    linesMap.insert(std::pair<std::string, std::string>(tag, lineStream.str()));
-                }
+            for (size_t i = 0; i < timecodes.size(); ++i) {
+                if (i > 0)
+                    buffer.push_back('|');
+                appendInt(buffer, timecodes[i].first);
+                buffer.push_back(',');
+                appendInt(buffer, timecodes[i].second);
             }
         }
+        buffer.push_back('\n');
     }
+}
 
-    for (auto itr = linesMap.begin(); itr != linesMap.end(); itr = linesMap.upper_bound(itr->first)) {
-        auto range = linesMap.equal_range(itr->first);
-        std::vector<std::string> linesWithSameTag;
-        while (range.first != range.second) {
-            linesWithSameTag.push_back(range.first->second);
-            ++range.first;
-        }
-        lyrics.emplace_back(linesWithSameTag, style);
+std::string CLyricItem::fileSaveString() const {
+    std::string buffer;
+    buffer.reserve(fileSaveSize());
+    appendFileSaveString(buffer);
+    return buffer;
+}
+
+CLyric::CLyric(const std::string &lyricContent, LyricStyle style) {
+    CLyricBuilder builder(style);
+    std::string_view text = lyricContent;
+
+    for (size_t lineBegin = 0; lineBegin <= text.size();) {
+        size_t lineEnd = text.find('\n', lineBegin);
+        if (lineEnd == std::string_view::npos)
+            lineEnd = text.size();
+        builder.addLine(text.substr(lineBegin, lineEnd - lineBegin));
+        lineBegin = lineEnd + 1;
     }
 
-    std::stable_sort(lyrics.begin(), lyrics.end(),
-                     [](const CLyricItem &item1, const CLyricItem &item2) {
-                         return item1.startTime < item2.startTime;
-                     });
+    builder.build(*this);
 }
 
 std::string CLyric::filename() const {
@@ -293,9 +187,12 @@ std::string CLyric::filename(const std::string &title, const std::string &album,
 }
 
 void CLyric::saveToFile(const std::string &saveDirectoryPath) {
-    std::ofstream saveFile(std::filesystem::u8path(saveDirectoryPath + "/" + filename()), std::ios::out);
-    saveFile << readableString();
+    std::string path = saveDirectoryPath + "/" + filename();
+    std::string contents = readableString();
+    std::ofstream saveFile(std::filesystem::u8path(path), std::ios::out);
+    saveFile.write(contents.data(), static_cast<std::streamsize>(contents.size()));
     saveFile.close();
+    saveBinaryCache(*this, path);
 }
 
 void CLyric::mergeTranslation(const CLyric &trans) {
@@ -305,32 +202,48 @@ void CLyric::mergeTranslation(const CLyric &trans) {
     }
 }
 
-std::string CLyric::readableString() {
-    std::ostringstream stringStream;
-    stringStream << "[ti]" << track.title << '\n';
+void CLyric::appendReadableString(std::string &buffer) const {
+    size_t size = 32 + track.title.size() + track.album.size() + track.artist.size();
+    if (!track.instrumental) {
+        for (const CLyricItem &item: lyrics)
+            size += item.fileSaveSize();
+    }
+    buffer.reserve(buffer.size() + size);
+
+    buffer.append("[ti]").append(track.title).push_back('\n');
     if (!track.album.empty()) {
-        stringStream << "[al]" << track.album << '\n';
+        buffer.append("[al]").append(track.album).push_back('\n');
     }
     if (!track.artist.empty()) {
-        stringStream << "[ar]" << track.artist << '\n';
+        buffer.append("[ar]").append(track.artist).push_back('\n');
     }
     if (track.duration > 0) {
-        stringStream << "[du]" << track.duration << '\n';
+        buffer.append("[du]");
+        appendInt(buffer, track.duration);
+        buffer.push_back('\n');
     }
     if (offset != 0) {
-        stringStream << "[offset]" << ((offset > 0) ? "+" : "") << offset << '\n';
+        buffer.append((offset > 0) ? "[offset]+" : "[offset]");
+        appendInt(buffer, offset);
+        buffer.push_back('\n');
     }
     if (track.instrumental) {
-        stringStream << "[instrumental]\n";
+        buffer.append("[instrumental]\n");
     } else {
-        for (auto item: lyrics) {
-            stringStream << item.fileSaveString();
+        for (const CLyricItem &item: lyrics) {
+            item.appendFileSaveString(buffer);
         }
     }
-    return stringStream.str();
+}
+
+std::string CLyric::readableString() const {
+    std::string buffer;
+    appendReadableString(buffer);
+    return buffer;
 }
 
 void CLyric::deleteFile(const std::string &saveDirectoryPath) {
     remove(std::filesystem::u8path(saveDirectoryPath + "/" + filename()));
+    remove(std::filesystem::u8path(binaryCachePath(saveDirectoryPath + "/" + filename())));
 }
 
@@ -7,10 +7,10 @@
 #define CRYSTALLYRICS_CLYRIC_H
 
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <functional>
-#include <regex>
 
 namespace cLyric {
 
@@ -20,12 +20,80 @@ namespace cLyric {
         KugouStyle       // Unique time tag and timecode style
     };
 
+    // Word timecodes of a line as (ms, chars) pairs. A [tc] payload is kept as text until the
+    // timecodes are first read, so lyrics which are never rendered with karaoke fill skip decoding it.
+    // Decoding happens in const accessors, an item must not be read from several threads at once.
+    class CLyricTimecodes {
+    public:
+        using value_type = std::pair<int, int>;
+        using const_iterator = std::vector<value_type>::const_iterator;
+
+    private:
+        std::string raw; // Undecoded "ms,chars|ms,chars|..." payload, cleared on modification
+        mutable std::vector<value_type> timecodeValues;
+        mutable bool decoded = true;
+
+        void decode() const;
+
+    public:
+        CLyricTimecodes() = default;
+
+        CLyricTimecodes(std::vector<value_type> values) : timecodeValues(std::move(values)) {}
+
+        // Adds a [tc] payload, which stays undecoded if there are no timecodes yet. A payload without
+        // well-formed pairs is ignored.
+        void appendRaw(std::string_view payload);
+
+        // The payload the timecodes were read from, empty if they were built or modified otherwise
+        [[nodiscard]] std::string_view rawPayload() const { return raw; }
+
+        [[nodiscard]] const std::vector<value_type> &values() const {
+            if (!decoded)
+                decode();
+            return timecodeValues;
+        }
+
+        // Decodes and drops the payload, for modification
+        std::vector<value_type> &edit();
+
+        // Does not decode, appendRaw only keeps payloads with timecodes
+        [[nodiscard]] bool empty() const { return raw.empty() && timecodeValues.empty(); }
+
+        [[nodiscard]] size_t size() const { return values().size(); }
+
+        [[nodiscard]] const_iterator begin() const { return values().begin(); }
+
+        [[nodiscard]] const_iterator end() const { return values().end(); }
+
+        [[nodiscard]] const value_type &operator[](size_t index) const { return values()[index]; }
+
+        [[nodiscard]] const value_type &front() const { return values().front(); }
+
+        [[nodiscard]] const value_type &back() const { return values().back(); }
+
+        void emplace_back(int time, int chars) { edit().emplace_back(time, chars); }
+
+        void clear() {
+            raw.clear();
+            timecodeValues.clear();
+            decoded = true;
+        }
+
+        bool operator==(const CLyricTimecodes &timecodes) const { return values() == timecodes.values(); }
+
+        bool operator==(const std::vector<value_type> &timecodes) const { return values() == timecodes; }
+
+        bool operator!=(const CLyricTimecodes &timecodes) const { return !(*this == timecodes); }
+
+        bool operator!=(const std::vector<value_type> &timecodes) const { return !(*this == timecodes); }
+    };
+
     class CLyricItem {
     public:
 
         CLyricItem(std::string content, const int startTime,
                    std::string translation = "",
-                   std::vector<std::pair<int, int>> timecodes = std::vector<std::pair<int, int>>()) :
+                   CLyricTimecodes timecodes = CLyricTimecodes()) :
                 content(std::move(content)), translation(std::move(translation)),
                 startTime(startTime), timecodes(std::move(timecodes)) {}
 
@@ -34,10 +102,16 @@ namespace cLyric {
         [[nodiscard]] bool isDoubleLine() const { return !translation.empty(); }
 
         std::string content, translation;
-        int startTime;
-        std::vector<std::pair<int, int>> timecodes; // std::vector<std::map<ms, chars>>
+        int startTime = 0;
+        CLyricTimecodes timecodes;
 
-        std::string fileSaveString();
+        std::string fileSaveString() const;
+
+        // Appends the lines of fileSaveString to buffer
+        void appendFileSaveString(std::string &buffer) const;
+
+        // Estimated size of fileSaveString, used to reserve buffers
+        [[nodiscard]] size_t fileSaveSize() const;
 
         bool operator<(const CLyricItem &item) const;
 
@@ -80,7 +154,7 @@ namespace cLyric {
 
         CLyric(Track track, std::vector<CLyricItem> lyrics) : track(std::move(track)), lyrics(std::move(lyrics)) {}
 
-        explicit CLyric(std::string lyricContent, LyricStyle style = CLrcStyle);
+        explicit CLyric(const std::string &lyricContent, LyricStyle style = CLrcStyle);
 
         CLyric(const std::string &lyricContent, Track track, LyricStyle style = CLrcStyle) : CLyric(lyricContent,
                                                                                                     style) {
@@ -93,7 +167,10 @@ namespace cLyric {
 
         [[nodiscard]] std::string filename() const;
 
-        std::string readableString();
+        std::string readableString() const;
+
+        // Appends readableString to buffer, which is reserved for it once
+        void appendReadableString(std::string &buffer) const;
 
         void saveToFile(const std::string &saveDirectoryPath);
 
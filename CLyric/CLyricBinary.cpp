@@ -0,0 +1,357 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricBinary.h"
+
+#ifdef _WIN32
+#define NOMINMAX // Eliminate Win32 min and max
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+using namespace cLyric;
+
+static_assert(sizeof(CLyricBinary::Header) == 96, "CLyricBinary header layout changed");
+static_assert(sizeof(CLyricBinary::Item) == 24, "CLyricBinary item layout changed");
+static_assert(std::is_trivially_copyable_v<CLyricBinary::Header> && std::is_trivially_copyable_v<CLyricBinary::Item>);
+
+namespace {
+
+    uint32_t checksum(const char *data, size_t size) {
+        uLong crc = crc32(0L, Z_NULL, 0);
+        while (size > 0) {
+            auto chunk = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+            crc = crc32(crc, reinterpret_cast<const Bytef *>(data), chunk);
+            data += chunk;
+            size -= chunk;
+        }
+        return static_cast<uint32_t>(crc);
+    }
+
+    void appendVarint(std::string &buffer, int value) {
+        auto zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        while (zigzag >= 0x80) {
+            buffer.push_back(static_cast<char>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        buffer.push_back(static_cast<char>(zigzag));
+    }
+
+    bool readVarint(const uint8_t *&pos, const uint8_t *end, int &value) {
+        uint32_t zigzag = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (pos == end)
+                return false;
+            uint8_t byte = *pos++;
+            zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                value = static_cast<int>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CLyricBinary::StringRef appendString(std::string &stringTable, std::string_view str) {
+        CLyricBinary::StringRef ref{static_cast<uint32_t>(stringTable.size()), static_cast<uint32_t>(str.size())};
+        stringTable.append(str);
+        return ref;
+    }
+
+    template<typename T>
+    void appendRaw(std::string &buffer, const T &value) {
+        buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    bool sourceStamp(const std::string &textPath, uint64_t &size, int64_t &time) {
+        std::error_code error;
+        auto path = std::filesystem::u8path(textPath);
+        size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        auto writeTime = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+        time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+        return true;
+    }
+
+}
+
+CLyricBinary::~CLyricBinary() {
+    close();
+}
+
+bool CLyricBinary::open(const std::string &path) {
+    close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileW(std::filesystem::u8path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(Header))) {
+        close();
+        return false;
+    }
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        close();
+        return false;
+    }
+    data = static_cast<const char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    dataSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+    data = static_cast<const char *>(mapped);
+    dataSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    if (data == nullptr || !validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CLyricBinary::close() {
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    mappingHandle = fileHandle = nullptr;
+#else
+    if (data)
+        munmap(const_cast<char *>(data), dataSize);
+#endif
+    data = nullptr;
+    dataSize = 0;
+    header = nullptr;
+    startTimes = nullptr;
+    items = nullptr;
+    timecodeData = nullptr;
+    stringTable = nullptr;
+}
+
+bool CLyricBinary::validate() {
+    auto fileHeader = reinterpret_cast<const Header *>(data);
+    if (fileHeader->magic != magic || fileHeader->version != version)
+        return false;
+
+    uint64_t itemCount = fileHeader->itemCount;
+    uint64_t expectedSize = sizeof(Header) + itemCount * (sizeof(int32_t) + sizeof(Item)) +
+                            fileHeader->timecodeSize + fileHeader->stringTableSize;
+    if (expectedSize != dataSize)
+        return false;
+    if (checksum(data + sizeof(Header), dataSize - sizeof(Header)) != fileHeader->checksum)
+        return false;
+    if (fileHeader->contentLanguage > Track::Language::other || fileHeader->translateLanguage > Track::Language::other)
+        return false;
+
+    const char *pos = data + sizeof(Header);
+    auto fileStartTimes = reinterpret_cast<const int32_t *>(pos);
+    pos += itemCount * sizeof(int32_t);
+    auto fileItems = reinterpret_cast<const Item *>(pos);
+    pos += itemCount * sizeof(Item);
+    auto fileTimecodes = reinterpret_cast<const uint8_t *>(pos);
+    pos += fileHeader->timecodeSize;
+
+    uint32_t stringTableSize = fileHeader->stringTableSize;
+    auto validString = [stringTableSize](const StringRef &ref) {
+        return ref.offset <= stringTableSize && ref.length <= stringTableSize - ref.offset;
+    };
+    for (const StringRef *ref: {&fileHeader->title, &fileHeader->album, &fileHeader->artist,
+                                &fileHeader->coverImageUrl, &fileHeader->source}) {
+        if (!validString(*ref))
+            return false;
+    }
+    for (size_t i = 0; i < itemCount; ++i) {
+        if (i > 0 && fileStartTimes[i] < fileStartTimes[i - 1])
+            return false;
+        const Item &item = fileItems[i];
+        if (!validString(item.content) || !validString(item.translation) ||
+            item.timecodeOffset > fileHeader->timecodeSize)
+            return false;
+        // Each timecode is a pair of varints taking at least two bytes, which bounds the reserve in timecodes()
+        if (item.timecodeCount > (fileHeader->timecodeSize - item.timecodeOffset) / 2)
+            return false;
+    }
+
+    header = fileHeader;
+    startTimes = fileStartTimes;
+    items = fileItems;
+    timecodeData = fileTimecodes;
+    stringTable = pos;
+    return true;
+}
+
+Track CLyricBinary::track() const {
+    Track track(std::string(string(header->title)), std::string(string(header->album)),
+                std::string(string(header->artist)), std::string(string(header->coverImageUrl)),
+                std::string(string(header->source)), header->duration, header->instrumental != 0);
+    track.contentLanguage = static_cast<Track::Language>(header->contentLanguage);
+    track.translateLanguage = static_cast<Track::Language>(header->translateLanguage);
+    return track;
+}
+
+void CLyricBinary::timecodes(size_t index, std::vector<std::pair<int, int>> &timecodes) const {
+    const Item &item = items[index];
+    const uint8_t *pos = timecodeData + item.timecodeOffset, *end = timecodeData + header->timecodeSize;
+
+    timecodes.clear();
+    timecodes.reserve(item.timecodeCount);
+    int time = 0, chars;
+    for (uint32_t i = 0; i < item.timecodeCount; ++i) {
+        int delta;
+        if (!readVarint(pos, end, delta) || !readVarint(pos, end, chars))
+            break;
+        time += delta;
+        timecodes.emplace_back(time, chars);
+    }
+}
+
+CLyric CLyricBinary::toCLyric() const {
+    std::vector<CLyricItem> lyrics;
+    lyrics.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        lyrics.emplace_back(std::string(content(i)), startTime(i), std::string(translation(i)));
+        timecodes(i, lyrics.back().timecodes.edit());
+    }
+
+    CLyric lyric(track(), std::move(lyrics));
+    lyric.offset = offset();
+    return lyric;
+}
+
+bool CLyricBinary::write(const CLyric &lyric, const std::string &path, uint64_t sourceSize, int64_t sourceTime) {
+    const Track &track = lyric.track;
+    std::string stringTable, timecodeBuffer;
+
+    Header fileHeader{};
+    fileHeader.magic = magic;
+    fileHeader.version = version;
+    fileHeader.sourceSize = sourceSize;
+    fileHeader.sourceTime = sourceTime;
+    fileHeader.offset = lyric.offset;
+    fileHeader.duration = track.duration;
+    fileHeader.instrumental = track.instrumental;
+    fileHeader.contentLanguage = track.contentLanguage;
+    fileHeader.translateLanguage = track.translateLanguage;
+    fileHeader.title = appendString(stringTable, track.title);
+    fileHeader.album = appendString(stringTable, track.album);
+    fileHeader.artist = appendString(stringTable, track.artist);
+    fileHeader.coverImageUrl = appendString(stringTable, track.coverImageUrl);
+    fileHeader.source = appendString(stringTable, track.source);
+
+    // Items are stored in start time order, the order readers see after parsing the .clrc file
+    std::vector<const CLyricItem *> sortedItems;
+    sortedItems.reserve(lyric.lyrics.size());
+    for (const CLyricItem &item: lyric.lyrics)
+        sortedItems.push_back(&item);
+    std::stable_sort(sortedItems.begin(), sortedItems.end(),
+                     [](const CLyricItem *item1, const CLyricItem *item2) { return *item1 < *item2; });
+
+    std::string payload;
+    payload.reserve(sortedItems.size() * (sizeof(int32_t) + sizeof(Item)));
+    for (const CLyricItem *item: sortedItems)
+        appendRaw(payload, static_cast<int32_t>(item->startTime));
+
+    for (const CLyricItem *item: sortedItems) {
+        Item fileItem{};
+        fileItem.content = appendString(stringTable, item->content);
+        fileItem.translation = appendString(stringTable, item->translation);
+        fileItem.timecodeOffset = static_cast<uint32_t>(timecodeBuffer.size());
+        fileItem.timecodeCount = static_cast<uint32_t>(item->timecodes.size());
+
+        int time = 0;
+        for (const auto &[timecodeTime, chars]: item->timecodes) {
+            appendVarint(timecodeBuffer, timecodeTime - time);
+            appendVarint(timecodeBuffer, chars);
+            time = timecodeTime;
+        }
+        appendRaw(payload, fileItem);
+    }
+
+    fileHeader.itemCount = static_cast<uint32_t>(sortedItems.size());
+    fileHeader.timecodeSize = static_cast<uint32_t>(timecodeBuffer.size());
+    fileHeader.stringTableSize = static_cast<uint32_t>(stringTable.size());
+    payload.append(timecodeBuffer);
+    payload.append(stringTable);
+    fileHeader.checksum = checksum(payload.data(), payload.size());
+
+    // Written aside and renamed, so readers never map a partially written file
+    auto filePath = std::filesystem::u8path(path);
+    auto tempPath = filePath;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file.write(reinterpret_cast<const char *>(&fileHeader), sizeof(Header));
+        file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!file.good())
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, filePath, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool cLyric::saveBinaryCache(const CLyric &lyric, const std::string &textPath) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!sourceStamp(textPath, sourceSize, sourceTime))
+        return false;
+    return CLyricBinary::write(lyric, binaryCachePath(textPath), sourceSize, sourceTime);
+}
+
+bool cLyric::loadBinaryCache(const std::string &textPath, CLyric &lyric) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!sourceStamp(textPath, sourceSize, sourceTime))
+        return false;
+
+    CLyricBinary binary;
+    if (!binary.open(binaryCachePath(textPath)))
+        return false;
+    if (binary.sourceSize() != sourceSize || binary.sourceTime() != sourceTime)
+        return false;
+
+    lyric = binary.toCLyric();
+    return true;
+}
@@ -0,0 +1,119 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICBINARY_H
+#define CRYSTALLYRICS_CLYRICBINARY_H
+
+#include "CLyric.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+namespace cLyric {
+
+    // Compiled form of a .clrc file, saved next to it as .clrcb.
+    // Layout: Header | int32 startTimes[itemCount] | Item items[itemCount] | timecodes | string table
+    // Timecodes are stored per item as zigzag varints, the ms part as the delta to the previous one.
+    // The file is mapped and validated on open, the accessors read it in place without parsing.
+    class CLyricBinary {
+    public:
+        static constexpr uint32_t magic = 0x42524C43; // "CLRB"
+        static constexpr uint32_t version = 1;
+
+        struct StringRef {
+            uint32_t offset, length;
+        };
+
+        struct Header {
+            uint32_t magic, version;
+            uint64_t sourceSize; // Size and write time of the .clrc file the cache is compiled from
+            int64_t sourceTime;
+            uint32_t checksum;   // CRC32 of everything after the header
+            uint32_t itemCount, timecodeSize, stringTableSize;
+            int32_t offset, duration;
+            uint8_t instrumental, contentLanguage, translateLanguage, reserved;
+            StringRef title, album, artist, coverImageUrl, source;
+            uint32_t padding;
+        };
+
+        struct Item {
+            StringRef content, translation;
+            uint32_t timecodeOffset, timecodeCount;
+        };
+
+    private:
+        const char *data = nullptr;
+        size_t dataSize = 0;
+#ifdef _WIN32
+        void *fileHandle = nullptr, *mappingHandle = nullptr;
+#endif
+
+        const Header *header = nullptr;
+        const int32_t *startTimes = nullptr;
+        const Item *items = nullptr;
+        const uint8_t *timecodeData = nullptr;
+        const char *stringTable = nullptr;
+
+        [[nodiscard]] bool validate();
+
+        [[nodiscard]] std::string_view string(const StringRef &ref) const {
+            return std::string_view(stringTable + ref.offset, ref.length);
+        }
+
+    public:
+        CLyricBinary() = default;
+
+        CLyricBinary(const CLyricBinary &) = delete;
+
+        CLyricBinary &operator=(const CLyricBinary &) = delete;
+
+        ~CLyricBinary();
+
+        // Maps the file and validates it, returns false if it is missing or malformed
+        bool open(const std::string &path);
+
+        void close();
+
+        [[nodiscard]] bool isOpen() const { return header != nullptr; }
+
+        [[nodiscard]] uint64_t sourceSize() const { return header->sourceSize; }
+
+        [[nodiscard]] int64_t sourceTime() const { return header->sourceTime; }
+
+        [[nodiscard]] size_t size() const { return header->itemCount; }
+
+        [[nodiscard]] int offset() const { return header->offset; }
+
+        [[nodiscard]] Track track() const;
+
+        [[nodiscard]] int startTime(size_t index) const { return startTimes[index]; }
+
+        [[nodiscard]] std::string_view content(size_t index) const { return string(items[index].content); }
+
+        [[nodiscard]] std::string_view translation(size_t index) const { return string(items[index].translation); }
+
+        void timecodes(size_t index, std::vector<std::pair<int, int>> &timecodes) const;
+
+        [[nodiscard]] CLyric toCLyric() const;
+
+        // Compiles the lyric into a .clrcb file, stamped with the size and write time of its .clrc file
+        static bool write(const CLyric &lyric, const std::string &path, uint64_t sourceSize, int64_t sourceTime);
+    };
+
+    // The .clrcb path of a .clrc file
+    inline std::string binaryCachePath(const std::string &textPath) { return textPath + 'b'; }
+
+    // Compiles the .clrcb file of textPath from lyric, which should be the contents of textPath
+    bool saveBinaryCache(const CLyric &lyric, const std::string &textPath);
+
+    // Loads the .clrcb file of textPath if it is up to date with textPath
+    bool loadBinaryCache(const std::string &textPath, CLyric &lyric);
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICBINARY_H
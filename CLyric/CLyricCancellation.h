@@ -0,0 +1,53 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICCANCELLATION_H
+#define CRYSTALLYRICS_CLYRICCANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace cLyric {
+
+    // Stops a search when it is cancelled or runs past its deadline. Copies share the same state,
+    // so the owner keeps one copy to cancel while the search polls another from its threads.
+    class CLyricCancellation {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        struct State {
+            std::atomic<bool> cancelled{false};
+            Clock::time_point deadline;
+        };
+
+        std::shared_ptr<State> state;
+
+    public:
+        // Never expires, only stops once cancelled
+        CLyricCancellation() : CLyricCancellation(Clock::time_point::max()) {}
+
+        explicit CLyricCancellation(Clock::duration budget) : CLyricCancellation(Clock::now() + budget) {}
+
+        explicit CLyricCancellation(Clock::time_point deadline) : state(std::make_shared<State>()) {
+            state->deadline = deadline;
+        }
+
+        void cancel() const { state->cancelled.store(true, std::memory_order_relaxed); }
+
+        [[nodiscard]] bool isCancelled() const { return state->cancelled.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] bool isExpired() const { return Clock::now() >= state->deadline; }
+
+        // Whether the search should give up and return what it has
+        [[nodiscard]] bool shouldStop() const { return isCancelled() || isExpired(); }
+
+        [[nodiscard]] Clock::time_point deadline() const { return state->deadline; }
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICCANCELLATION_H
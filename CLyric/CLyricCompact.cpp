@@ -0,0 +1,58 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricCompact.h"
+
+#include <algorithm>
+
+using namespace cLyric;
+
+CLyricCompact::CLyricCompact(const CLyric &lyric) : track(lyric.track), offset(lyric.offset) {
+    size_t textLength = 0, timecodeCount = 0;
+    for (const CLyricItem &item: lyric.lyrics) {
+        textLength += item.content.size() + item.translation.size();
+        timecodeCount += item.timecodes.size();
+    }
+
+    text.reserve(textLength);
+    items.reserve(lyric.lyrics.size());
+    timecodeList.reserve(timecodeCount);
+
+    for (const CLyricItem &item: lyric.lyrics) {
+        Item compactItem{};
+        compactItem.startTime = item.startTime;
+
+        compactItem.contentOffset = text.size();
+        compactItem.contentLength = item.content.size();
+        text.append(item.content);
+
+        compactItem.translationOffset = text.size();
+        compactItem.translationLength = item.translation.size();
+        text.append(item.translation);
+
+        compactItem.timecodeOffset = timecodeList.size();
+        compactItem.timecodeCount = item.timecodes.size();
+        timecodeList.insert(timecodeList.end(), item.timecodes.begin(), item.timecodes.end());
+
+        items.push_back(compactItem);
+    }
+}
+
+CLyric CLyricCompact::toCLyric() const {
+    std::vector<CLyricItem> lyrics;
+    lyrics.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        lyrics.emplace_back(std::string(content(i)), startTime(i), std::string(translation(i)),
+                            std::vector<std::pair<int, int>>(timecodesBegin(i), timecodesEnd(i)));
+    }
+
+    CLyric lyric(track, std::move(lyrics));
+    lyric.offset = offset;
+    return lyric;
+}
+
+bool CLyricCompact::hasTranslation() const {
+    return std::any_of(items.begin(), items.end(), [](const Item &item) { return item.translationLength > 0; });
+}
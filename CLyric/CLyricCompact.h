@@ -0,0 +1,76 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICCOMPACT_H
+#define CRYSTALLYRICS_CLYRICCOMPACT_H
+
+#include "CLyric.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+namespace cLyric {
+
+    // Compact form of CLyric: the text of all items lives in one buffer and all timecodes in one array,
+    // so copying a lyric costs a few allocations regardless of its line count.
+    class CLyricCompact {
+        struct Item {
+            int startTime;
+            uint32_t contentOffset, contentLength;
+            uint32_t translationOffset, translationLength;
+            uint32_t timecodeOffset, timecodeCount;
+        };
+
+        std::string text;
+        std::vector<Item> items;
+        std::vector<std::pair<int, int>> timecodeList;
+
+    public:
+        Track track;
+        int offset = 0; // in milliseconds
+
+        CLyricCompact() = default;
+
+        explicit CLyricCompact(const CLyric &lyric);
+
+        [[nodiscard]] CLyric toCLyric() const;
+
+        [[nodiscard]] size_t size() const { return items.size(); }
+
+        [[nodiscard]] bool empty() const { return items.empty(); }
+
+        [[nodiscard]] int startTime(size_t index) const { return items[index].startTime; }
+
+        [[nodiscard]] std::string_view content(size_t index) const {
+            return std::string_view(text).substr(items[index].contentOffset, items[index].contentLength);
+        }
+
+        [[nodiscard]] std::string_view translation(size_t index) const {
+            return std::string_view(text).substr(items[index].translationOffset, items[index].translationLength);
+        }
+
+        [[nodiscard]] const std::pair<int, int> *timecodesBegin(size_t index) const {
+            return timecodeList.data() + items[index].timecodeOffset;
+        }
+
+        [[nodiscard]] const std::pair<int, int> *timecodesEnd(size_t index) const {
+            return timecodesBegin(index) + items[index].timecodeCount;
+        }
+
+        [[nodiscard]] bool hasTranslation() const;
+
+        [[nodiscard]] bool hasTimecodes() const { return !timecodeList.empty(); }
+
+        [[nodiscard]] bool isValid() const {
+            return (!track.title.empty() && (track.instrumental || !items.empty()));
+        };
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICCOMPACT_H
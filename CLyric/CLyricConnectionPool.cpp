@@ -0,0 +1,91 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricConnectionPool.h"
+
+using namespace cLyric;
+
+CLyricConnectionPool::CLyricConnectionPool() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    shareHandle = curl_share_init();
+    curl_share_setopt(shareHandle, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(shareHandle, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(shareHandle, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+}
+
+CLyricConnectionPool::~CLyricConnectionPool() {
+    for (CURL *handle: idleHandles)
+        curl_easy_cleanup(handle);
+    curl_share_cleanup(shareHandle);
+    curl_global_cleanup();
+}
+
+CLyricConnectionPool &CLyricConnectionPool::instance() {
+    static CLyricConnectionPool pool;
+    return pool;
+}
+
+void CLyricConnectionPool::lockShare(CURL *, curl_lock_data data, curl_lock_access, void *pool) {
+    static_cast<CLyricConnectionPool *>(pool)->shareMutexes[data].lock();
+}
+
+void CLyricConnectionPool::unlockShare(CURL *, curl_lock_data data, void *pool) {
+    static_cast<CLyricConnectionPool *>(pool)->shareMutexes[data].unlock();
+}
+
+void CLyricConnectionPool::setDefaults(CURL *handle) {
+    curl_easy_setopt(handle, CURLOPT_SHARE, shareHandle);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "br, gzip, deflate");
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "CrystalLyrics/0.0.1");
+    curl_easy_setopt(handle, CURLOPT_COOKIEFILE, "");
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L); // Wait for a connection to multiplex on over opening one
+}
+
+CURL *CLyricConnectionPool::acquire() {
+    CURL *handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (!idleHandles.empty()) {
+            handle = idleHandles.back();
+            idleHandles.pop_back();
+        }
+    }
+    if (handle) {
+        // Keeps the connections and caches of the handle, drops the options of its previous user
+        curl_easy_reset(handle);
+    } else {
+        handle = curl_easy_init();
+    }
+    setDefaults(handle);
+    return handle;
+}
+
+void CLyricConnectionPool::release(CURL *handle) {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (idleHandles.size() < maxIdleHandles) {
+            idleHandles.push_back(handle);
+            return;
+        }
+    }
+    curl_easy_cleanup(handle);
+}
+
+CURL *CLyricConnectionPool::duplicate(CURL *handle) {
+    CURL *copy = curl_easy_duphandle(handle);
+    curl_easy_setopt(copy, CURLOPT_SHARE, shareHandle); // Not copied by curl_easy_duphandle
+    return copy;
+}
@@ -0,0 +1,58 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICCONNECTIONPOOL_H
+#define CRYSTALLYRICS_CLYRICCONNECTIONPOOL_H
+
+#include <curl/curl.h>
+
+#include <mutex>
+#include <vector>
+
+namespace cLyric {
+
+    // Process-wide curl state shared by all providers of all CLyricSearch instances.
+    // DNS cache, TLS sessions, live connections and cookies live in one share handle, so a new search
+    // reuses the connections of the previous one. HTTP/2 is negotiated over TLS where the host supports it.
+    class CLyricConnectionPool {
+        CURLSH *shareHandle;
+        std::mutex shareMutexes[CURL_LOCK_DATA_LAST];
+
+        std::mutex idleMutex;
+        std::vector<CURL *> idleHandles;
+
+        static constexpr size_t maxIdleHandles = 16;
+
+        CLyricConnectionPool();
+
+        static void lockShare(CURL *handle, curl_lock_data data, curl_lock_access access, void *pool);
+
+        static void unlockShare(CURL *handle, curl_lock_data data, void *pool);
+
+        void setDefaults(CURL *handle);
+
+    public:
+        CLyricConnectionPool(const CLyricConnectionPool &) = delete;
+
+        CLyricConnectionPool &operator=(const CLyricConnectionPool &) = delete;
+
+        ~CLyricConnectionPool();
+
+        static CLyricConnectionPool &instance();
+
+        // A handle with the default options on the shared state, an idle one if there is any
+        CURL *acquire();
+
+        // Gives the handle back, its options are reset when it is acquired again
+        void release(CURL *handle);
+
+        // Copy of a handle with all its options, on the shared state as well. Clean it up with curl_easy_cleanup,
+        // its connections stay in the pool.
+        CURL *duplicate(CURL *handle);
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICCONNECTIONPOOL_H
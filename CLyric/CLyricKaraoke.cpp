@@ -0,0 +1,49 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricKaraoke.h"
+
+#include <algorithm>
+
+using namespace cLyric;
+
+CLyricKaraokeCursor::CLyricKaraokeCursor(const CLyricTimecodes &timecodes, const std::vector<double> &charPositions) {
+    if (!charPositions.empty()) {
+        *this = CLyricKaraokeCursor(timecodes, charPositions.size() - 1,
+                                    [&charPositions](size_t chars) { return charPositions[chars]; });
+    }
+}
+
+CLyricKaraokeCursor::CLyricKaraokeCursor(const CLyricTimecodes &timecodes, size_t charCount,
+                                         const std::function<double(size_t chars)> &position) {
+    times.reserve(timecodes.size());
+    positions.reserve(timecodes.size());
+    for (size_t i = 0; i < timecodes.size(); ++i) {
+        size_t chars = charCount;
+        if (i + 1 < timecodes.size())
+            chars = std::min(static_cast<size_t>(std::max(timecodes[i].second, 0)), charCount);
+        times.push_back(timecodes[i].first);
+        positions.push_back(position(chars));
+    }
+}
+
+size_t CLyricKaraokeCursor::segment(int time) const {
+    auto next = std::upper_bound(times.begin(), times.end(), time);
+    return next == times.begin() ? 0 : static_cast<size_t>(next - times.begin()) - 1;
+}
+
+double CLyricKaraokeCursor::position(int time) const {
+    if (times.empty())
+        return 0;
+
+    if (time < times.front())
+        return positions.front();
+    size_t index = segment(time);
+    if (index + 1 == times.size() || times[index + 1] <= times[index])
+        return positions[index];
+
+    const double progress = double(time - times[index]) / (times[index + 1] - times[index]);
+    return positions[index] + (positions[index + 1] - positions[index]) * progress;
+}
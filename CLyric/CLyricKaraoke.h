@@ -0,0 +1,49 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICKARAOKE_H
+#define CRYSTALLYRICS_CLYRICKARAOKE_H
+
+#include "CLyric.h"
+
+#include <functional>
+#include <vector>
+
+namespace cLyric {
+
+    // Karaoke fill of one line, built once when the line is prepared. Holds the fill position (e.g. pixels)
+    // reached at each timecode and interpolates linearly in between, timecodes are expected in time order.
+    class CLyricKaraokeCursor {
+        std::vector<int> times;
+        std::vector<double> positions;
+
+    public:
+        CLyricKaraokeCursor() = default;
+
+        // charPositions[n] is the position after the first n code points of the line,
+        // the last timecode always reaches the end of the line
+        CLyricKaraokeCursor(const CLyricTimecodes &timecodes, const std::vector<double> &charPositions);
+
+        // position(n) is the position after the first n code points of the line. It is only asked for the
+        // char counts the timecodes end at, and for charCount.
+        CLyricKaraokeCursor(const CLyricTimecodes &timecodes, size_t charCount,
+                            const std::function<double(size_t chars)> &position);
+
+        [[nodiscard]] bool empty() const { return times.empty(); }
+
+        [[nodiscard]] size_t size() const { return times.size(); }
+
+        // Time the fill reaches the end of the line, relative to the line start
+        [[nodiscard]] int endTime() const { return times.empty() ? 0 : times.back(); }
+
+        // Index of the segment the time falls into, 0 before the first timecode
+        [[nodiscard]] size_t segment(int time) const;
+
+        [[nodiscard]] double position(int time) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICKARAOKE_H
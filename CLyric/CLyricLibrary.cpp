@@ -0,0 +1,181 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricLibrary.h"
+#include "CLyricUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace cLyric;
+
+namespace {
+
+    constexpr size_t batchSize = 32; // Files read back to back by one task
+
+    // Task queue of one worker, the owner pops from the back and other workers steal from the front
+    class WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+
+    public:
+        void push(size_t task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(task);
+        }
+
+        bool pop(size_t &task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            task = tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+
+        bool steal(size_t &task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            task = tasks.front();
+            tasks.pop_front();
+            return true;
+        }
+    };
+
+    bool readFile(const std::string &path, uint64_t size, std::string &buffer, std::string &error) {
+        std::ifstream file(std::filesystem::u8path(path), std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+            error = "Cannot open file";
+            return false;
+        }
+        buffer.resize(size);
+        file.read(buffer.data(), static_cast<std::streamsize>(size));
+        buffer.resize(static_cast<size_t>(file.gcount()));
+        if (file.bad()) {
+            error = "Cannot read file";
+            return false;
+        }
+        return true;
+    }
+
+}
+
+std::vector<std::string> CLyricLibrary::files() const {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (const auto &entry: std::filesystem::directory_iterator(std::filesystem::u8path(directoryPath), error)) {
+        if (entry.is_regular_file(error) && entry.path().extension() == ".clrc")
+            paths.push_back(entry.path().u8string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+CLyricLibraryStats CLyricLibrary::load(std::vector<CLyricLibraryEntry> &entries, const EntryCallback &callback,
+                                       unsigned threadCount) const {
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::string> paths = files();
+    entries.clear();
+    entries.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        entries[i].path = std::move(paths[i]);
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(std::filesystem::u8path(entries[i].path), error);
+        // A failed stat returns uintmax_t(-1), which must not become the read buffer size
+        if (error)
+            entries[i].error = "Cannot stat file: " + error.message();
+        else
+            entries[i].size = size;
+    }
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t batchCount = (entries.size() + batchSize - 1) / batchSize;
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, batchCount)));
+
+    // Batches are dealt round-robin, workers which run out steal from the others
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned i = 0; i < threadCount; ++i)
+        queues.push_back(std::make_unique<WorkQueue>());
+    for (size_t batch = 0; batch < batchCount; ++batch)
+        queues[batch % threadCount]->push(batch);
+
+    auto processBatch = [&entries, &callback](size_t batch, std::string &buffer) {
+        size_t end = std::min(entries.size(), (batch + 1) * batchSize);
+        for (size_t i = batch * batchSize; i < end; ++i) {
+            CLyricLibraryEntry &entry = entries[i];
+            if (!entry.error.empty())
+                continue;
+
+            // Reading is inside the try too, an exception escaping a worker would terminate the program
+            try {
+                if (!readFile(entry.path, entry.size, buffer, entry.error))
+                    continue;
+                entry.size = buffer.size();
+                if (!utf8Validate(buffer)) {
+                    entry.error = "Invalid UTF-8";
+                    continue;
+                }
+
+                CLyric lyric(buffer, LyricStyle::CLrcStyle);
+                entry.valid = lyric.isValid();
+                if (callback)
+                    callback(entry, lyric);
+            } catch (const std::exception &e) {
+                entry.error = e.what();
+            }
+        }
+    };
+
+    auto worker = [&queues, &processBatch, threadCount](unsigned index) {
+        std::string buffer;
+        size_t batch;
+        while (true) {
+            if (queues[index]->pop(batch)) {
+                processBatch(batch, buffer);
+                continue;
+            }
+            // No batch is added after start, so the work is done once nothing can be stolen
+            bool stolen = false;
+            for (unsigned i = 1; i < threadCount && !stolen; ++i)
+                stolen = queues[(index + i) % threadCount]->steal(batch);
+            if (!stolen)
+                break;
+            processBatch(batch, buffer);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread &thread: threads)
+        thread.join();
+
+    CLyricLibraryStats stats;
+    stats.threads = threadCount;
+    stats.files = entries.size();
+    for (const CLyricLibraryEntry &entry: entries) {
+        stats.bytes += entry.size;
+        if (!entry.error.empty()) {
+            ++stats.failedFiles;
+        } else if (entry.valid) {
+            ++stats.validFiles;
+        } else {
+            ++stats.invalidFiles;
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return stats;
+}
@@ -0,0 +1,59 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICLIBRARY_H
+#define CRYSTALLYRICS_CLYRICLIBRARY_H
+
+#include "CLyric.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace cLyric {
+
+    struct CLyricLibraryEntry {
+        std::string path;
+        uint64_t size = 0;   // in bytes
+        bool valid = false;  // CLyric::isValid of the parsed lyric
+        std::string error;   // Read or parse error, empty if the file was parsed
+    };
+
+    struct CLyricLibraryStats {
+        size_t files = 0, validFiles = 0, invalidFiles = 0, failedFiles = 0;
+        uint64_t bytes = 0;
+        unsigned threads = 0;
+        double seconds = 0;
+
+        [[nodiscard]] double filesPerSecond() const { return seconds > 0 ? double(files) / seconds : 0; }
+
+        [[nodiscard]] double megabytesPerSecond() const {
+            return seconds > 0 ? double(bytes) / (1024 * 1024) / seconds : 0;
+        }
+    };
+
+    // Bulk access to the .clrc files saved by CLyric::saveToFile
+    class CLyricLibrary {
+        std::string directoryPath;
+
+    public:
+        // Called from the worker threads for every parsed file
+        using EntryCallback = std::function<void(const CLyricLibraryEntry &, const CLyric &)>;
+
+        explicit CLyricLibrary(std::string directoryPath) : directoryPath(std::move(directoryPath)) {}
+
+        // Paths of the .clrc files in the directory, sorted
+        [[nodiscard]] std::vector<std::string> files() const;
+
+        // Reads and parses all .clrc files in batches on a work-stealing thread pool,
+        // entries receive the result of every file in the order of files()
+        CLyricLibraryStats load(std::vector<CLyricLibraryEntry> &entries, const EntryCallback &callback = nullptr,
+                                unsigned threadCount = 0) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICLIBRARY_H
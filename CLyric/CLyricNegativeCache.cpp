@@ -0,0 +1,117 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricNegativeCache.h"
+#include "CLyricUtils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+using namespace cLyric;
+
+namespace {
+
+    // Guards the read-modify-write of the cache file between the search threads
+    std::mutex fileMutex;
+
+    int64_t secondsSinceEpoch() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Tabs and newlines separate the fields and entries of the file
+    std::string field(const std::string &str) {
+        std::string result = utf8Encode(MatchKey(str).str());
+        std::replace_if(result.begin(), result.end(), [](char ch) { return ch == '\t' || ch == '\n'; }, ' ');
+        return result;
+    }
+
+}
+
+CLyricNegativeCache::CLyricNegativeCache(const std::string &directoryPath)
+        : filePath(directoryPath + "/NoLyrics.cache") {}
+
+std::string CLyricNegativeCache::key(const Track &track) {
+    int bucket = track.duration > 0 ? track.duration / durationBucket : -1;
+    return field(track.title) + '\t' + field(track.artist) + '\t' + field(track.album) + '\t' +
+           std::to_string(bucket);
+}
+
+std::map<std::string, CLyricNegativeCache::Entry> CLyricNegativeCache::read() const {
+    std::map<std::string, Entry> entries;
+    std::ifstream file(std::filesystem::u8path(filePath));
+    std::string line;
+    // Lines are "title\tartist\talbum\tbucket\tmisses\tnextCheck"
+    while (std::getline(file, line)) {
+        size_t missesBegin = line.rfind('\t');
+        if (missesBegin == std::string::npos || missesBegin == 0)
+            continue;
+        missesBegin = line.rfind('\t', missesBegin - 1);
+        if (missesBegin == std::string::npos)
+            continue;
+        Entry entry;
+        std::istringstream fields(line.substr(missesBegin + 1));
+        if (fields >> entry.misses >> entry.nextCheck)
+            entries[line.substr(0, missesBegin)] = entry;
+    }
+    return entries;
+}
+
+void CLyricNegativeCache::write(const std::map<std::string, Entry> &entries) const {
+    // An entry whose check is overdue by more than the longest interval belongs to a track no longer played
+    int64_t expiry = secondsSinceEpoch() - std::chrono::seconds(maxInterval).count();
+    // Written aside and renamed, so a crash never leaves a truncated file behind
+    std::string temporaryPath = filePath + ".tmp";
+    bool written;
+    {
+        std::ofstream file(std::filesystem::u8path(temporaryPath), std::ios::out | std::ios::trunc);
+        for (const auto &[key, entry]: entries) {
+            if (entry.nextCheck >= expiry)
+                file << key << '\t' << entry.misses << '\t' << entry.nextCheck << '\n';
+        }
+        written = file.good();
+    }
+    std::error_code error;
+    if (written)
+        std::filesystem::rename(std::filesystem::u8path(temporaryPath), std::filesystem::u8path(filePath), error);
+    if (!written || error)
+        std::filesystem::remove(std::filesystem::u8path(temporaryPath), error);
+}
+
+bool CLyricNegativeCache::shouldSkip(const Track &track) const {
+    return secondsToNextCheck(track) > 0;
+}
+
+int64_t CLyricNegativeCache::secondsToNextCheck(const Track &track) const {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    auto entries = read();
+    auto entry = entries.find(key(track));
+    if (entry == entries.end())
+        return 0;
+    return std::max<int64_t>(0, entry->second.nextCheck - secondsSinceEpoch());
+}
+
+void CLyricNegativeCache::recordMiss(const Track &track) {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    auto entries = read();
+    Entry &entry = entries[key(track)];
+    ++entry.misses;
+    // firstInterval << (misses - 1), capped before it can overflow
+    int64_t interval = std::chrono::seconds(maxInterval).count();
+    if (entry.misses < 32)
+        interval = std::min(interval, std::chrono::seconds(firstInterval).count() << (entry.misses - 1));
+    entry.nextCheck = secondsSinceEpoch() + interval;
+    write(entries);
+}
+
+void CLyricNegativeCache::remove(const Track &track) {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    auto entries = read();
+    if (entries.erase(key(track)) > 0)
+        write(entries);
+}
@@ -0,0 +1,60 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICNEGATIVECACHE_H
+#define CRYSTALLYRICS_CLYRICNEGATIVECACHE_H
+
+#include "CLyric.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace cLyric {
+
+    // Tracks no provider had lyrics for, kept in the lyric directory so they are not searched on every play.
+    // A track is searched again once its re-check interval has passed, the interval doubles with every miss.
+    // Every call works on the file itself, so instances on different threads stay consistent.
+    class CLyricNegativeCache {
+    public:
+        static constexpr auto firstInterval = std::chrono::hours(1);
+        static constexpr auto maxInterval = std::chrono::hours(24 * 30);
+        static constexpr int durationBucket = 10; // in seconds, durations within a bucket share an entry
+
+    private:
+        struct Entry {
+            int misses = 0;
+            int64_t nextCheck = 0; // in seconds since the epoch
+        };
+
+        std::string filePath;
+
+        [[nodiscard]] std::map<std::string, Entry> read() const;
+
+        void write(const std::map<std::string, Entry> &entries) const;
+
+    public:
+        explicit CLyricNegativeCache(const std::string &directoryPath);
+
+        // Normalized title, artist and album with the duration bucket
+        static std::string key(const Track &track);
+
+        // Whether the track missed before and is not due for another search yet
+        [[nodiscard]] bool shouldSkip(const Track &track) const;
+
+        // A search found nothing, the next one waits twice as long as the last
+        void recordMiss(const Track &track);
+
+        // Forgets the track, after a search found it or before a manual one
+        void remove(const Track &track);
+
+        // Seconds until the track is searched again, 0 if it is not in the cache
+        [[nodiscard]] int64_t secondsToNextCheck(const Track &track) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICNEGATIVECACHE_H
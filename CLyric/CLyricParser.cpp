@@ -0,0 +1,579 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricParser.h"
+#include "CLyricUtils.h"
+
+#include <cctype>
+#include <charconv>
+#include <algorithm>
+
+using namespace cLyric;
+
+namespace {
+
+    inline bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool isWordChar(char c) {
+        return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    inline bool isDigits(std::string_view str, size_t pos, size_t length) {
+        if (pos + length > str.size())
+            return false;
+        for (size_t i = pos; i < pos + length; ++i) {
+            if (!isDigit(str[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // End of the digit run starting at pos
+    inline size_t digitRunEnd(std::string_view str, size_t pos) {
+        while (pos < str.size() && isDigit(str[pos]))
+            ++pos;
+        return pos;
+    }
+
+    inline int digitsValue(std::string_view digits) {
+        int value = 0;
+        std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        return value;
+    }
+
+    // Matches the whole tag text against (\d{2})?:?(\d{2,3}):(\d{2})\.?(\d{1,3})?,
+    // trying the alternatives in the same order as a backtracking regex engine would.
+    bool parseTimeTag(std::string_view tag, int &time) {
+        for (size_t hourLength: {2, 0}) {
+            if (hourLength && !isDigits(tag, 0, hourLength))
+                continue;
+            for (size_t colonLength: {1, 0}) {
+                if (colonLength && (hourLength >= tag.size() || tag[hourLength] != ':'))
+                    continue;
+                const size_t minutePos = hourLength + colonLength;
+                for (size_t minuteLength: {3, 2}) {
+                    if (!isDigits(tag, minutePos, minuteLength))
+                        continue;
+                    size_t secondPos = minutePos + minuteLength;
+                    if (secondPos >= tag.size() || tag[secondPos] != ':')
+                        continue;
+                    ++secondPos;
+                    if (!isDigits(tag, secondPos, 2))
+                        continue;
+                    const size_t dotPos = secondPos + 2;
+                    for (size_t dotLength: {1, 0}) {
+                        if (dotLength && (dotPos >= tag.size() || tag[dotPos] != '.'))
+                            continue;
+                        const size_t millisecondPos = dotPos + dotLength;
+                        if (millisecondPos > tag.size())
+                            continue;
+                        const size_t millisecondLength = tag.size() - millisecondPos;
+                        if (millisecondLength > 3 || !isDigits(tag, millisecondPos, millisecondLength))
+                            continue;
+
+                        int hourTime = hourLength ? digitsValue(tag.substr(0, hourLength)) : 0;
+                        int minuteTime = digitsValue(tag.substr(minutePos, minuteLength));
+                        int secondTime = digitsValue(tag.substr(secondPos, 2));
+                        int millisecondTime = digitsValue(tag.substr(millisecondPos, millisecondLength));
+
+                        switch (millisecondLength) {
+                            case 1:
+                                millisecondTime *= 100;
+                                break;
+                            case 2:
+                                millisecondTime *= 10;
+                                break;
+                            default:;
+                        }
+
+                        time = hourTime * 60 * 60 * 1000 + minuteTime * 60 * 1000 + secondTime * 1000 +
+                               millisecondTime;
+
+                        if (secondTime >= 60) { // some mm:ss:ms format
+                            time += secondTime;
+                        }
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // Matches the whole tag text against \d+,\d+
+    bool parseKugouTimeTag(std::string_view tag, int &time) {
+        size_t comma = digitRunEnd(tag, 0);
+        if (comma == 0 || comma >= tag.size() || tag[comma] != ',')
+            return false;
+        size_t end = digitRunEnd(tag, comma + 1);
+        if (end == comma + 1 || end != tag.size())
+            return false;
+        time = digitsValue(tag.substr(0, comma));
+        return true;
+    }
+
+    bool isWordTag(std::string_view tag) {
+        if (tag.empty())
+            return false;
+        for (char c: tag) {
+            if (!isWordChar(c))
+                return false;
+        }
+        return true;
+    }
+
+    // Finds the last "<digits>" marker, returns the position after '>' and the digits
+    bool findLastXiamiMarker(std::string_view str, std::string_view &digits, size_t &wordPos) {
+        for (size_t pos = str.rfind('<'); pos != std::string_view::npos; pos = pos ? str.rfind('<', pos - 1)
+                                                                                   : std::string_view::npos) {
+            size_t end = digitRunEnd(str, pos + 1);
+            if (end > pos + 1 && end < str.size() && str[end] == '>') {
+                digits = str.substr(pos + 1, end - pos - 1);
+                wordPos = end + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Matches "digits,digits,digits>" at pos, returns the end positions of the first two numbers and of the marker
+    bool matchKugouMarker(std::string_view str, size_t pos, size_t &firstEnd, size_t &secondEnd, size_t &markerEnd) {
+        firstEnd = digitRunEnd(str, pos);
+        if (firstEnd == pos || firstEnd >= str.size() || str[firstEnd] != ',')
+            return false;
+        secondEnd = digitRunEnd(str, firstEnd + 1);
+        if (secondEnd == firstEnd + 1 || secondEnd >= str.size() || str[secondEnd] != ',')
+            return false;
+        size_t thirdEnd = digitRunEnd(str, secondEnd + 1);
+        if (thirdEnd == secondEnd + 1 || thirdEnd >= str.size() || str[thirdEnd] != '>')
+            return false;
+        markerEnd = thirdEnd + 1;
+        return true;
+    }
+
+}
+
+void CLyricLineTokens::clear() {
+    tags.clear();
+    hasLeadingTags = false;
+    content = remainder = std::string_view();
+    hasTimeTag = hasKugouTimeTag = false;
+    time = kugouTime = 0;
+    wordTag = std::string_view();
+}
+
+void cLyric::tokenizeLyricLine(std::string_view line, CLyricLineTokens &tokens) {
+    tokens.clear();
+
+    bool leading = true;
+    size_t pos = 0, leadingEnd = 0, lastEnd = 0;
+    while ((pos = line.find('[', pos)) != std::string_view::npos) {
+        const size_t close = line.find(']', pos + 1);
+        if (close == std::string_view::npos)
+            break;
+
+        std::string_view tag = line.substr(pos + 1, close - pos - 1);
+        tokens.tags.push_back(tag);
+
+        if (leading && pos == leadingEnd) {
+            leadingEnd = close + 1;
+            tokens.hasLeadingTags = true;
+        } else {
+            leading = false;
+        }
+
+        // A typed tag can only start at the last '[' before the closing bracket
+        const size_t innerOpen = tag.rfind('[');
+        std::string_view innerTag = innerOpen == std::string_view::npos ? tag : tag.substr(innerOpen + 1);
+        if (!tokens.hasTimeTag)
+            tokens.hasTimeTag = parseTimeTag(innerTag, tokens.time);
+        if (!tokens.hasKugouTimeTag)
+            tokens.hasKugouTimeTag = parseKugouTimeTag(innerTag, tokens.kugouTime);
+        if (tokens.wordTag.empty() && isWordTag(innerTag))
+            tokens.wordTag = innerTag;
+
+        lastEnd = pos = close + 1;
+    }
+
+    if (tokens.hasLeadingTags)
+        tokens.content = line.substr(leadingEnd);
+    tokens.remainder = line.substr(lastEnd);
+}
+
+bool cLyric::parseLeadingInt(std::string_view str, int &value) {
+    size_t pos = 0;
+    while (pos < str.size() && std::isspace(static_cast<unsigned char>(str[pos])))
+        ++pos;
+    if (pos < str.size() && str[pos] == '+')
+        ++pos;
+    auto result = std::from_chars(str.data() + pos, str.data() + str.size(), value);
+    return result.ec == std::errc();
+}
+
+namespace {
+
+    // Calls handler with every well-formed "ms,chars" pair of a [tc] payload until it returns false
+    template<typename Handler>
+    void forEachTimecode(std::string_view payload, Handler handler) {
+        size_t begin = 0;
+        while (true) {
+            size_t end = payload.find('|', begin);
+            std::string_view timecode = payload.substr(begin, end == std::string_view::npos ? end : end - begin);
+
+            int time, chars;
+            size_t comma = timecode.find(',');
+            if (comma != std::string_view::npos && parseLeadingInt(timecode.substr(0, comma), time) &&
+                parseLeadingInt(timecode.substr(comma + 1), chars) && !handler(time, chars))
+                return;
+
+            if (end == std::string_view::npos)
+                break;
+            begin = end + 1;
+        }
+    }
+
+}
+
+void cLyric::parseTimecodes(std::string_view payload, std::vector<std::pair<int, int>> &timecodes) {
+    forEachTimecode(payload, [&timecodes](int time, int chars) {
+        timecodes.emplace_back(time, chars);
+        return true;
+    });
+}
+
+bool cLyric::hasTimecodes(std::string_view payload) {
+    bool found = false;
+    forEachTimecode(payload, [&found](int, int) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool cLyric::parseXiamiTimecodes(std::string_view &lineContent, std::string &content,
+                                 std::vector<std::pair<int, int>> &timecodes) {
+    std::string_view lastDigits;
+    size_t lastWordPos;
+    if (!findLastXiamiMarker(lineContent, lastDigits, lastWordPos))
+        return false;
+
+    int totalTime = 0, charNum = 0; // Number of character "char", not the byte "char"
+    timecodes.emplace_back(totalTime, charNum);
+    content.clear();
+
+    size_t pos = 0, consumed = 0;
+    while (pos < lineContent.size()) {
+        if (!isDigit(lineContent[pos])) {
+            ++pos;
+            continue;
+        }
+        size_t end = digitRunEnd(lineContent, pos);
+        if (end >= lineContent.size() || lineContent[end] != '>') {
+            pos = end;
+            continue;
+        }
+        size_t next = lineContent.find('<', end + 1);
+        if (next == std::string_view::npos)
+            break;
+
+        std::string_view word = lineContent.substr(end + 1, next - end - 1);
+        totalTime += digitsValue(lineContent.substr(pos, end - pos));
+        charNum += utf8StringChars(word);
+        timecodes.emplace_back(totalTime, charNum);
+        content.append(word);
+        consumed = pos = next + 1;
+    }
+
+    std::string_view lastWord = lineContent.substr(lastWordPos);
+    lineContent.remove_prefix(consumed);
+    totalTime += digitsValue(lastDigits);
+    charNum += utf8StringChars(lastWord);
+    timecodes.emplace_back(totalTime, charNum);
+    content.append(lastWord);
+    return true;
+}
+
+bool cLyric::parseKugouTimecodes(std::string_view &lineContent, std::string &content,
+                                 std::vector<std::pair<int, int>> &timecodes) {
+    size_t firstEnd, secondEnd, markerEnd;
+
+    size_t lastMarker = std::string_view::npos;
+    for (size_t pos = lineContent.rfind('<'); pos != std::string_view::npos;
+         pos = pos ? lineContent.rfind('<', pos - 1) : std::string_view::npos) {
+        if (matchKugouMarker(lineContent, pos + 1, firstEnd, secondEnd, markerEnd)) {
+            lastMarker = pos + 1;
+            break;
+        }
+    }
+    if (lastMarker == std::string_view::npos)
+        return false;
+
+    const int lastTimeCodeStart = digitsValue(lineContent.substr(lastMarker, firstEnd - lastMarker));
+    const int lastTimeCodeLength = digitsValue(lineContent.substr(firstEnd + 1, secondEnd - firstEnd - 1));
+    std::string_view lastWord = lineContent.substr(markerEnd);
+
+    int totalTime = 0, charNum = 0; // Number of character "char", not the byte "char"
+    timecodes.emplace_back(totalTime, charNum);
+    content.clear();
+
+    size_t pos = 0, consumed = 0;
+    while (pos < lineContent.size()) {
+        if (!isDigit(lineContent[pos])) {
+            ++pos;
+            continue;
+        }
+        if (!matchKugouMarker(lineContent, pos, firstEnd, secondEnd, markerEnd)) {
+            pos = digitRunEnd(lineContent, pos);
+            continue;
+        }
+        size_t next = lineContent.find('<', markerEnd);
+        if (next == std::string_view::npos)
+            break;
+
+        std::string_view word = lineContent.substr(markerEnd, next - markerEnd);
+        // totalTime = start + length;
+        totalTime = digitsValue(lineContent.substr(pos, firstEnd - pos)) +
+                    digitsValue(lineContent.substr(firstEnd + 1, secondEnd - firstEnd - 1));
+        charNum += utf8StringChars(word);
+        timecodes.emplace_back(totalTime, charNum);
+        content.append(word);
+        consumed = pos = next + 1;
+    }
+
+    lineContent.remove_prefix(consumed);
+    totalTime = lastTimeCodeStart + lastTimeCodeLength;
+    charNum += utf8StringChars(lastWord);
+    timecodes.emplace_back(totalTime, charNum);
+    content.append(lastWord);
+    return true;
+}
+
+CLyricLineKind cLyric::lyricLineKind(std::string_view wordTag) {
+    if (wordTag.empty())
+        return CLyricLineKind::Content;
+    if (wordTag == "tr")
+        return CLyricLineKind::Translation;
+    if (wordTag == "tc")
+        return CLyricLineKind::Timecodes;
+    return CLyricLineKind::Tagged;
+}
+
+void cLyric::applyLyricLine(CLyricItem &item, CLyricLineKind kind, std::string_view lineContent, LyricStyle style) {
+    switch (kind) {
+        case CLyricLineKind::Translation:
+            item.translation = lineContent;
+            break;
+        case CLyricLineKind::Timecodes:
+            item.timecodes.appendRaw(lineContent);
+            break;
+        case CLyricLineKind::Content:
+            if (style == LyricStyle::XiamiStyle) {
+                parseXiamiTimecodes(lineContent, item.content, item.timecodes.edit());
+            } else if (style == LyricStyle::KugouStyle) {
+                parseKugouTimecodes(lineContent, item.content, item.timecodes.edit());
+            }
+            break;
+        case CLyricLineKind::Tagged:
+            break;
+    }
+
+    if (item.content.empty()) {
+        item.content = lineContent;
+    }
+}
+
+bool CLyricBuilder::parseTagTime(std::string_view tag, int &time) const {
+    const size_t innerOpen = tag.rfind('[');
+    if (innerOpen != std::string_view::npos)
+        tag.remove_prefix(innerOpen + 1);
+    return style == LyricStyle::KugouStyle ? parseKugouTimeTag(tag, time) : parseTimeTag(tag, time);
+}
+
+void CLyricBuilder::addRecords(const std::vector<std::string_view> &tags, CLyricLineKind kind,
+                               std::string_view content) {
+    const auto contentOffset = static_cast<uint32_t>(text.size());
+    bool stored = false;
+
+    for (std::string_view tag: tags) {
+        int time;
+        if (!isTimeTag(tag) || !parseTagTime(tag, time))
+            continue;
+        if (!stored) {
+            text.append(content);
+            stored = true;
+        }
+        records.push_back({time, kind, contentOffset, static_cast<uint32_t>(content.size())});
+    }
+}
+
+void CLyricBuilder::addLine(std::string_view line) {
+    if (line.find('\r') != std::string_view::npos) {
+        strippedLine.clear();
+        for (char c: line) {
+            if (c != '\r')
+                strippedLine.push_back(c);
+        }
+        line = strippedLine;
+    }
+
+    tokenizeLyricLine(line, tokens);
+    const std::vector<std::string_view> &tags = tokens.tags;
+
+    if (tags.size() == 1) {
+        std::string_view tag = tags[0];
+        if (isTimeTag(tag)) {
+            addRecords(tags, CLyricLineKind::Content, tokens.remainder);
+        } else {
+            std::string_view content = tokens.content;
+            if (tag == "ti") {
+                track.title = content;
+            } else if (tag == "al") {
+                track.album = content;
+            } else if (tag == "ar") {
+                track.artist = content;
+            } else if (tag == "du") {
+                // Parsed without throwing, this runs inside the write callback of curl. Bad values are ignored.
+                int duration;
+                if (parseLeadingInt(content, duration))
+                    track.duration = duration;
+            } else if (tag == "offset") {
+                int value;
+                if (parseLeadingInt(content, value))
+                    offset = value;
+            } else if (tag == "instrumental") {
+                track.instrumental = true;
+            } else if (style == LyricStyle::XiamiStyle && tag == "x-trans") {
+                tokenizeLyricLine(previousLine, previousTokens);
+
+                if (content.empty()) { // Empty trans
+                    content = previousTokens.content;
+                }
+
+                addRecords(previousTokens.tags, CLyricLineKind::Translation, content);
+            }
+        }
+    } else if (!tags.empty()) {
+        // Other tags of the line act as word tags of the content, the last one first
+        std::string_view wordTag;
+        for (auto itr = tags.rbegin(); itr != tags.rend(); ++itr) {
+            if (!isTimeTag(*itr) && isWordTag(*itr)) {
+                wordTag = *itr;
+                break;
+            }
+        }
+        addRecords(tags, lyricLineKind(wordTag), tokens.content);
+    }
+
+    previousLine.assign(line);
+}
+
+CLyricItem CLyricBuilder::buildItem(const CLyricLineRecord *begin, const CLyricLineRecord *end) const {
+    CLyricItem item("", begin != end ? begin->time : 0);
+    for (const CLyricLineRecord *record = begin; record != end; ++record) {
+        applyLyricLine(item, record->kind, std::string_view(text).substr(record->offset, record->length), style);
+    }
+    return item;
+}
+
+void CLyricBuilder::build(CLyric &lyric) {
+    lyric.track = std::move(track);
+    lyric.offset = offset;
+
+    // Equal times keep the line order, like the lines of one item
+    std::stable_sort(records.begin(), records.end(),
+                     [](const CLyricLineRecord &record1, const CLyricLineRecord &record2) {
+                         return record1.time < record2.time;
+                     });
+
+    for (auto begin = records.begin(); begin != records.end();) {
+        auto end = begin;
+        while (end != records.end() && end->time == begin->time)
+            ++end;
+        lyric.lyrics.push_back(buildItem(&*begin, &*begin + (end - begin)));
+        begin = end;
+    }
+}
+
+void CLyricStreamParser::emitPending(size_t end) {
+    if (!hasPending)
+        return;
+    hasPending = false;
+    if (!itemCallback || !emittedTimes.insert(pendingTime).second)
+        return;
+
+    const auto &records = builder.lineRecords();
+    itemCallback(builder.buildItem(records.data() + pendingBegin, records.data() + end));
+}
+
+void CLyricStreamParser::processLine(std::string_view line) {
+    const size_t begin = builder.lineRecords().size();
+    builder.addLine(line);
+    const auto &records = builder.lineRecords();
+    if (records.size() == begin)
+        return;
+
+    const int time = records[begin].time;
+    bool singleTime = std::all_of(records.begin() + begin, records.end(),
+                                  [time](const CLyricLineRecord &record) { return record.time == time; });
+
+    if (singleTime) {
+        if (!hasPending || pendingTime != time) {
+            emitPending(begin);
+            hasPending = true;
+            pendingTime = time;
+            pendingBegin = begin;
+        }
+    } else {
+        // Lines with multiple time tags (e.g. repeated chorus) are only complete at the end
+        emitPending(begin);
+    }
+}
+
+void CLyricStreamParser::feed(const char *data, size_t size) {
+    if (size == 0 || finished)
+        return;
+    if (!started) {
+        started = true;
+        firstByte = data[0];
+    }
+
+    std::string_view chunk(data, size);
+    size_t lineBegin = 0, lineEnd;
+    while ((lineEnd = chunk.find('\n', lineBegin)) != std::string_view::npos) {
+        if (lineBuffer.empty()) {
+            processLine(chunk.substr(lineBegin, lineEnd - lineBegin));
+        } else {
+            lineBuffer.append(chunk.substr(lineBegin, lineEnd - lineBegin));
+            processLine(lineBuffer);
+            lineBuffer.clear();
+        }
+        lineBegin = lineEnd + 1;
+    }
+    lineBuffer.append(chunk.substr(lineBegin));
+}
+
+CLyric CLyricStreamParser::finish() {
+    CLyric lyric;
+    if (finished)
+        return lyric;
+    finished = true;
+
+    processLine(lineBuffer);
+    lineBuffer.clear();
+    emitPending(builder.lineRecords().size());
+
+    builder.build(lyric);
+
+    // Items of multi-tagged lines are only complete now
+    if (itemCallback) {
+        for (const CLyricItem &item: lyric.lyrics) {
+            if (emittedTimes.insert(item.startTime).second)
+                itemCallback(item);
+        }
+    }
+    return lyric;
+}
@@ -0,0 +1,151 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICPARSER_H
+#define CRYSTALLYRICS_CLYRICPARSER_H
+
+#include "CLyric.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <set>
+#include <functional>
+
+namespace cLyric {
+
+    // Tokens of a single lyric line, gathered in one linear scan over the line.
+    // Views point into the scanned line, which must outlive the tokens.
+    struct CLyricLineTokens {
+        std::vector<std::string_view> tags; // Text of every [tag] in the line, in order
+        bool hasLeadingTags = false;        // Line starts with at least one [tag]
+        std::string_view content;           // Text after the leading [tag]s
+        std::string_view remainder;         // Text after the last [tag]
+
+        bool hasTimeTag = false;            // First [hh:mm:ss.ms] style tag
+        int time = 0;
+        bool hasKugouTimeTag = false;       // First [start,length] style tag
+        int kugouTime = 0;
+        std::string_view wordTag;           // First [word] tag, e.g. "tr" or "tc"
+
+        void clear();
+    };
+
+    void tokenizeLyricLine(std::string_view line, CLyricLineTokens &tokens);
+
+    // Lyric line kinds, decided by the first [word] tag of the line
+    enum class CLyricLineKind : uint8_t {
+        Content,      // No word tag, may contain Xiami/Kugou word timecodes
+        Translation,  // [tr]
+        Timecodes,    // [tc]
+        Tagged        // Any other word tag
+    };
+
+    CLyricLineKind lyricLineKind(std::string_view wordTag);
+
+    // Applies the text of one line (after its leading tags) to the item it belongs to
+    void applyLyricLine(CLyricItem &item, CLyricLineKind kind, std::string_view lineContent, LyricStyle style);
+
+    inline bool isTimeTag(std::string_view tag) {
+        return !tag.empty() && tag[0] >= '0' && tag[0] <= '9';
+    }
+
+    // Parses a leading integer the way std::stoi does, without throwing
+    bool parseLeadingInt(std::string_view str, int &value);
+
+    // "[tc]" payload: "ms,chars|ms,chars|..."
+    void parseTimecodes(std::string_view payload, std::vector<std::pair<int, int>> &timecodes);
+
+    // Whether a [tc] payload has a well-formed pair, stops at the first one
+    bool hasTimecodes(std::string_view payload);
+
+    // Xiami word timecodes: "<ms>word<ms>word..." with relative durations.
+    // lineContent is advanced past the consumed "<ms>word<" pairs.
+    bool parseXiamiTimecodes(std::string_view &lineContent, std::string &content,
+                             std::vector<std::pair<int, int>> &timecodes);
+
+    // Kugou word timecodes: "<start,length,0>word..." with offsets relative to the line.
+    // lineContent is advanced like in parseXiamiTimecodes.
+    bool parseKugouTimecodes(std::string_view &lineContent, std::string &content,
+                             std::vector<std::pair<int, int>> &timecodes);
+
+    // A line grouped under one of its time tags, its text lives in the CLyricBuilder text buffer
+    struct CLyricLineRecord {
+        int time;
+        CLyricLineKind kind;
+        uint32_t offset, length;
+    };
+
+    // Collects lyric lines one at a time and groups them by parsed time tag
+    class CLyricBuilder {
+        LyricStyle style;
+        Track track;
+        int offset = 0;
+
+        std::string text;
+        std::vector<CLyricLineRecord> records;
+
+        CLyricLineTokens tokens, previousTokens;
+        std::string previousLine, strippedLine;
+
+        bool parseTagTime(std::string_view tag, int &time) const;
+
+        void addRecords(const std::vector<std::string_view> &tags, CLyricLineKind kind, std::string_view content);
+
+    public:
+        explicit CLyricBuilder(LyricStyle style = CLrcStyle) : style(style) {}
+
+        // Adds a single line without its trailing '\n', '\r's are ignored
+        void addLine(std::string_view line);
+
+        [[nodiscard]] const std::vector<CLyricLineRecord> &lineRecords() const { return records; }
+
+        // Builds the item from records sharing the same time
+        [[nodiscard]] CLyricItem buildItem(const CLyricLineRecord *begin, const CLyricLineRecord *end) const;
+
+        void build(CLyric &lyric);
+    };
+
+    // Push-style parser which accepts the lyric text in arbitrary chunks (e.g. from curl write callbacks).
+    // Chunks may split lines and UTF-8 sequences, only the unfinished line is buffered.
+    // The item callback receives an item once a line with a different time tag arrives, which is when
+    // the item is complete for lyrics keeping lines of the same time together. Items of lines with
+    // multiple time tags are reported on finish(), which returns the complete lyric.
+    class CLyricStreamParser {
+        CLyricBuilder builder;
+        std::function<void(const CLyricItem &)> itemCallback;
+
+        std::string lineBuffer;
+        bool hasPending = false;
+        int pendingTime = 0;
+        size_t pendingBegin = 0;
+        std::set<int> emittedTimes;
+        char firstByte = '\0';
+        bool started = false, finished = false;
+
+        void processLine(std::string_view line);
+
+        void emitPending(size_t end);
+
+    public:
+        explicit CLyricStreamParser(LyricStyle style = CLrcStyle,
+                                    std::function<void(const CLyricItem &)> itemCallback = nullptr)
+                : builder(style), itemCallback(std::move(itemCallback)) {}
+
+        void feed(const char *data, size_t size);
+
+        void feed(std::string_view chunk) { feed(chunk.data(), chunk.size()); }
+
+        // First byte of the text, '\0' if nothing has been fed
+        [[nodiscard]] char front() const { return firstByte; }
+
+        CLyric finish();
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICPARSER_H
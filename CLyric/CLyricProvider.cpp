@@ -5,9 +5,13 @@
 
 #include "CLyricProvider.h"
 #include "CLyricUtils.h"
+#include "CLyricConnectionPool.h"
 #include "Base64.h"
 #include <nlohmann/json.hpp>
 #include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <memory>
 #include <numeric>
 #include <regex>
 
@@ -16,305 +20,456 @@ using nlohmann::json;
 using namespace cLyric;
 
 CLyricProvider::CLyricProvider() {
-    curlHandle = curl_easy_init();
-
-    curl_easy_setopt(curlHandle, CURLOPT_NOSIGNAL, 1);
-    curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT, 10);
-    curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT, 10);
+    curlHandle = CLyricConnectionPool::instance().acquire();
     curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, storeCURLResponse);
-    curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curlHandle, CURLOPT_FOLLOWLOCATION, 1);
-    curl_easy_setopt(curlHandle, CURLOPT_ACCEPT_ENCODING, "br, gzip, deflate");
-    curl_easy_setopt(curlHandle, CURLOPT_USERAGENT, "CrystalLyrics/0.0.1");
-    curl_easy_setopt(curlHandle, CURLOPT_COOKIEFILE, "");
+    curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(curlHandle, CURLOPT_XFERINFOFUNCTION, abortStoppedTransfer);
+    curl_easy_setopt(curlHandle, CURLOPT_XFERINFODATA, this);
+    curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 0L);
+
+    multiHandle = curl_multi_init();
+    curl_multi_setopt(multiHandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    setMaxHostConnections(4);
 }
 
 CLyricProvider::~CLyricProvider() {
-    curl_easy_cleanup(curlHandle);
+    curl_multi_cleanup(multiHandle);
+    CLyricConnectionPool::instance().release(curlHandle);
+}
+
+void CLyricProvider::setMaxHostConnections(long connections) {
+    curl_multi_setopt(multiHandle, CURLMOPT_MAX_HOST_CONNECTIONS, connections);
+}
+
+void CLyricProvider::setTimeout(std::chrono::milliseconds timeout) {
+    // downloadBatch duplicates curlHandle, so its transfers take the limits over
+    curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.count()));
+    curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(timeout.count()));
 }
 
 size_t CLyricProvider::storeCURLResponse(void *buffer, size_t size, size_t nmemb, void *userp) {
-    auto *targetString = static_cast<std::string *>(userp);
-    auto *responseBuffer = static_cast<char *>(buffer);
-    targetString->append(responseBuffer, size * nmemb);
+    auto *provider = static_cast<CLyricProvider *>(userp);
+    provider->response.append(static_cast<char *>(buffer), size * nmemb);
     return size * nmemb;
 }
 
-void CLyricProvider::normalizeName(std::string &str, bool isHttpParam, bool noSpecialChars) {
-    if (noSpecialChars) {
-        for (auto &c: str) {
-            if (static_cast<unsigned char>(c) > 127) {
-                // Non-Ascii char
+CURLcode CLyricProvider::performRequest(const std::string &url, const char *postFields) {
+    requestUrl = url;
+    requestBody = postFields ? postFields : "";
+    response.clear();
+    cachedResponse = CLyricResponseCache::instance().load(requestUrl, requestBody, response);
+    if (cachedResponse) {
+        responseCode = 200; // Only successful responses are stored
+        requestFailed = false;
+        return CURLE_OK;
+    }
+
+    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
+    if (postFields)
+        curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, postFields);
+    CURLcode result = curl_easy_perform(curlHandle);
+    if (postFields)
+        curl_easy_setopt(curlHandle, CURLOPT_HTTPGET, 1L);
+    countTransfer(curlHandle);
+    responseCode = 0;
+    curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &responseCode);
+    requestFailed = result != CURLE_OK || responseCode >= 400;
+    return result;
+}
+
+void CLyricProvider::cacheResponse(CLyricResponseCache::Kind kind) {
+    // file:// URLs have no response code
+    if (!cachedResponse && responseCode < 400)
+        CLyricResponseCache::instance().store(requestUrl, requestBody, kind, response);
+}
+
+void CLyricProvider::countTransfer(CURL *handle) {
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    ++transfers;
+    transferredBytes += static_cast<uint64_t>(bytes);
+}
+
+int CLyricProvider::abortStoppedTransfer(void *userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<CLyricProvider *>(userp)->cancellation.shouldStop() ? 1 : 0;
+}
+
+namespace {
+
+    // Longest wait for socket activity, bounds how late a stopped batch notices it
+    constexpr auto batchPollInterval = std::chrono::milliseconds(100);
+
+    struct BatchTransfer {
+        CURL *handle = nullptr;
+        size_t index = 0;
+        std::string body;
+        CLyricStreamParser *parser = nullptr;
+        bool keepBody = false; // Kept next to the parser for the response cache
+    };
+
+    size_t storeBatchResponse(void *buffer, size_t size, size_t nmemb, void *userp) {
+        auto *transfer = static_cast<BatchTransfer *>(userp);
+        if (transfer->parser)
+            transfer->parser->feed(static_cast<char *>(buffer), size * nmemb);
+        if (!transfer->parser || transfer->keepBody)
+            transfer->body.append(static_cast<char *>(buffer), size * nmemb);
+        return size * nmemb;
+    }
+
+    std::vector<std::string> lyricUrls(const std::vector<CLyricCandidate> &candidates) {
+        std::vector<std::string> urls;
+        urls.reserve(candidates.size());
+        for (const CLyricCandidate &candidate: candidates)
+            urls.push_back(candidate.lyricUrl);
+        return urls;
+    }
+
+    // Results of a batch kept per url, so they are returned in ranking order whichever completes first
+    void appendInOrder(std::vector<std::vector<CLyric>> &downloaded, std::vector<CLyric> &lyrics) {
+        for (std::vector<CLyric> &results: downloaded) {
+            lyrics.insert(lyrics.end(), std::make_move_iterator(results.begin()),
+                          std::make_move_iterator(results.end()));
+        }
+    }
+
+}
+
+CLyricCandidate CLyricProvider::candidate(Track track, std::string lyricUrl, const MatchKey &targetTitle,
+                                          const MatchKey &targetArtist) {
+    CLyricCandidate candidate;
+    candidate.distance = trackDistance(MatchKey(track.title), MatchKey(track.artist), targetTitle, targetArtist);
+    candidate.track = std::move(track);
+    candidate.lyricUrl = std::move(lyricUrl);
+    return candidate;
+}
+
+void CLyricProvider::selectCandidates(std::vector<CLyricCandidate> &candidates, const MatchKey &targetTitle,
+                                      const MatchKey &targetArtist) {
+    int maxDistance = maxTrackDistance(targetTitle, targetArtist);
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const CLyricCandidate &candidate1, const CLyricCandidate &candidate2) {
+                         return candidate1.distance < candidate2.distance;
+                     });
+    auto distant = [maxDistance](const CLyricCandidate &candidate) { return candidate.distance > maxDistance; };
+    candidates.erase(std::find_if(candidates.begin(), candidates.end(), distant), candidates.end());
+    if (candidates.size() > maxCandidates)
+        candidates.resize(maxCandidates);
+}
+
+void CLyricProvider::downloadBatch(const std::vector<std::string> &urls, size_t maxResults,
+                                   const BatchHandler &handler, std::vector<CLyricStreamParser> *parsers) {
+    std::vector<std::unique_ptr<BatchTransfer>> transfers;
+    size_t next = 0, results = 0;
+    CLyricResponseCache &cache = CLyricResponseCache::instance();
+    bool caching = cache.isOpen();
+
+    // Passes body to handler, or to the parser of index with handler getting an empty body
+    auto handle = [&handler, parsers](size_t index, std::string &body) {
+        if (!parsers)
+            return handler(index, body);
+        std::string empty;
+        return handler(index, empty);
+    };
+
+    // Removes the transfers still running if the handler throws
+    struct Cleanup {
+        CURLM *multiHandle;
+        std::vector<std::unique_ptr<BatchTransfer>> &transfers;
+
+        void finish(BatchTransfer &transfer) const {
+            curl_multi_remove_handle(multiHandle, transfer.handle);
+            curl_easy_cleanup(transfer.handle);
+            transfer.handle = nullptr;
+        }
+
+        ~Cleanup() {
+            for (auto &transfer: transfers) {
+                if (transfer->handle)
+                    finish(*transfer);
+            }
+        }
+    } cleanup{multiHandle, transfers};
+
+    auto startTransfers = [&] {
+        while (!cancellation.shouldStop() && next < urls.size() && results + transfers.size() < maxResults) {
+            std::string body;
+            if (caching && cache.load(urls[next], "", body)) {
+                if (parsers)
+                    (*parsers)[next].feed(body);
+                if (handle(next, body))
+                    ++results;
+                ++next;
                 continue;
             }
-            switch (c) {
-                case '!':
-                case '"':
-                case '#':
-                case '$':
-                case '%':
-                case '&':
-                case '\'':
-                case '(':
-                case ')':
-                case '*':
-                case '+':
-                case ',':
-                case '-':
-                case '.':
-                case '/':
-                case ':':
-                case ';':
-                case '<':
-                case '=':
-                case '>':
-                case '?':
-                case '@':
-                case '[':
-                case '\\':
-                case ']':
-                case '^':
-                case '_':
-                case '`':
-                case '{':
-                case '|':
-                case '}':
-                case '~':
-                    c = ' ';
+
+            auto transfer = std::make_unique<BatchTransfer>();
+            transfer->handle = CLyricConnectionPool::instance().duplicate(curlHandle);
+            transfer->index = next++;
+            transfer->keepBody = caching;
+            if (parsers)
+                transfer->parser = &(*parsers)[transfer->index];
+            curl_easy_setopt(transfer->handle, CURLOPT_URL, urls[transfer->index].c_str());
+            curl_easy_setopt(transfer->handle, CURLOPT_HTTPGET, 1L);
+            curl_easy_setopt(transfer->handle, CURLOPT_WRITEFUNCTION, storeBatchResponse);
+            curl_easy_setopt(transfer->handle, CURLOPT_WRITEDATA, transfer.get());
+            curl_easy_setopt(transfer->handle, CURLOPT_PRIVATE, transfer.get());
+            curl_multi_add_handle(multiHandle, transfer->handle);
+            transfers.push_back(std::move(transfer));
+        }
+    };
+
+    startTransfers();
+    while (!transfers.empty()) {
+        int running;
+        curl_multi_perform(multiHandle, &running);
+
+        CURLMsg *message;
+        int queued;
+        while ((message = curl_multi_info_read(multiHandle, &queued))) {
+            if (message->msg != CURLMSG_DONE)
+                continue;
+            BatchTransfer *transfer;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+            CURLcode result = message->data.result;
+            long code = 0;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+            countTransfer(message->easy_handle);
+            cleanup.finish(*transfer);
+
+            // Error pages are failed downloads, file:// URLs have no response code
+            if (result == CURLE_OK && code < 400 && handle(transfer->index, transfer->body)) {
+                ++results;
+                if (caching)
+                    cache.store(urls[transfer->index], "", CLyricResponseCache::Kind::Content, transfer->body);
             }
+            transfers.erase(std::find_if(transfers.begin(), transfers.end(),
+                                         [transfer](const auto &item) { return item.get() == transfer; }));
+            startTransfers();
         }
-    }
 
-    if (isHttpParam) {
-        char *escaped = curl_easy_escape(curlHandle, str.c_str(), 0);
-        str = escaped;
-        curl_free(escaped);
+        // The progress callback aborts the running transfers, this only stops waiting for them
+        if (cancellation.shouldStop())
+            break;
+        if (!transfers.empty())
+            curl_multi_poll(multiHandle, nullptr, 0, static_cast<int>(batchPollInterval.count()), nullptr);
     }
 }
 
-std::string CLyricProvider::normalizeName(const std::string &str, bool isHttpParam, bool noSpecialChars) {
-    std::string s = str;
-    normalizeName(s, isHttpParam, noSpecialChars);
-    return s;
-}
-
-void Gecimi::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
+std::vector<CLyricCandidate> Gecimi::searchCandidates(const Track &track) {
     std::string url = "http://gecimi.com/api/lyric/" + track.title;
 
-    if (track.artist.empty()) {
-        curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    } else {
+    if (!track.artist.empty()) {
         url.append("/");
         url.append(track.artist);
-        curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
     }
 
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
+    CURLcode curlResult = performRequest(url);
 
     if (curlResult != CURLE_OK)
-        return;
+        return {};
 
+    std::vector<CLyricCandidate> candidates;
     try {
         auto searchResult = json::parse(response);
-        std::vector<int> distances(searchResult["result"].size());
-        std::vector<CLyric> lyrics;
-        std::map<int, std::string> artistMap, coverMap;
-
-        for (size_t i = 0; i < searchResult["result"].size(); ++i) {
-            auto item = searchResult["result"][i];
-
-            // Get artist name
-            std::string artistName = track.artist;
-            int artistId = item["artist_id"];
-            int retryCount, maxTries = 3;
-            while (true) {
-                try {
-                    if (artistMap.find(artistId) == artistMap.end()) {
-                        std::string artistInfoUrl = "http://gecimi.com/api/artist/";
-                        artistInfoUrl.append(std::to_string(artistId));
-                        curl_easy_setopt(curlHandle, CURLOPT_URL, artistInfoUrl.c_str());
-                        response.clear();
-                        curl_easy_perform(curlHandle);
-                        auto artistInfo = json::parse(response);
-                        artistMap[artistId] = artistInfo["result"]["name"];
-                    }
-                    break;
-                } catch (json::exception &e) {
-                    if (++retryCount == maxTries) break;
-                }
-            }
-            artistName = artistMap[artistId];
-            item["artist"] = artistName;
+        const json &items = searchResult["result"];
+        std::map<int, std::string> artistMap;
+
+        MatchKey titleKey(track.title), artistKey(track.artist);
+        int maxDistance = maxTrackDistance(titleKey, artistKey);
 
-            distances[i] = stringDistance(item["song"], track.title) + stringDistance(artistName, track.artist) / 2;
+        // The artist costs a request, skip it for titles too far off on their own
+        std::vector<size_t> titleMatches;
+        std::vector<int> artistIds;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (matchDistance(MatchKey(items[i]["song"].get<std::string>()), titleKey, maxDistance) > maxDistance)
+                continue;
+            titleMatches.push_back(i);
+            int artistId = items[i]["artist_id"];
+            if (std::find(artistIds.begin(), artistIds.end(), artistId) == artistIds.end())
+                artistIds.push_back(artistId);
         }
 
-        std::vector<size_t> sorted_indexes = sort_indexes(distances);
-
-        int count = 0;
-        for (size_t sorted_index : sorted_indexes) {
-            auto item = searchResult["result"][sorted_index];
-
-            std::string coverImageUrl;
-            // Get album cover image
-            int albumId = item["aid"];
-            try {
-                if (coverMap.find(albumId) == coverMap.end()) {
-                    std::string albumInfoUrl = "http://gecimi.com/api/cover/";
-                    albumInfoUrl.append(std::to_string(albumId));
-                    curl_easy_setopt(curlHandle, CURLOPT_URL, albumInfoUrl.c_str());
-                    response.clear();
-                    curl_easy_perform(curlHandle);
-                    auto albumInfo = json::parse(response);
-                    coverMap[albumId] = albumInfo["result"]["cover"];
+        // Get artist names in one batch, retrying the ones which failed
+        int maxTries = 3;
+        for (int tries = 0; tries < maxTries && !artistIds.empty(); ++tries) {
+            std::vector<std::string> artistInfoUrls;
+            for (int artistId: artistIds)
+                artistInfoUrls.push_back("http://gecimi.com/api/artist/" + std::to_string(artistId));
+            downloadBatch(artistInfoUrls, artistInfoUrls.size(), [&artistMap, &artistIds](size_t index,
+                                                                                         std::string &body) {
+                try {
+                    auto artistInfo = json::parse(body);
+                    artistMap[artistIds[index]] = artistInfo["result"]["name"];
+                    return true;
+                } catch (json::exception &e) {
+                    return false;
                 }
-            } catch (json::exception &e) {
-                // Leave image empty
-            }
-            coverImageUrl = coverMap[albumId];
+            });
+            artistIds.erase(std::remove_if(artistIds.begin(), artistIds.end(), [&artistMap](int artistId) {
+                return artistMap.find(artistId) != artistMap.end();
+            }), artistIds.end());
+        }
 
-            curl_easy_setopt(curlHandle, CURLOPT_URL, item["lrc"].get<std::string>().c_str());
-            response.clear();
-            if (curl_easy_perform(curlHandle) != CURLE_OK)
-                continue;
+        for (size_t i: titleMatches) {
+            const json &item = items[i];
+            candidates.push_back(candidate(Track(item["song"], track.album, artistMap[item["artist_id"].get<int>()],
+                                                 "", "Gecimi"), item["lrc"], titleKey, artistKey));
+            candidates.back().providerData = std::to_string(item["aid"].get<int>());
+        }
+        selectCandidates(candidates, titleKey, artistKey);
+        cacheResponse(CLyricResponseCache::Kind::Search);
 
-            if (response.empty() || response[0] != '[')
-                continue;
+    } catch (json::exception &e) {
+        requestFailed = true;
+        return {};
+    }
+    return candidates;
+}
 
-            lyrics.emplace_back(response,
-                                Track(item["song"], track.album, item["artist"],
-                                      coverImageUrl, "Gecimi", track.duration));
-            if (++count > 5) break;
+std::vector<CLyric> Gecimi::downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) {
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<CLyricStreamParser> parsers(urls.size());
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&parsers, &downloaded](size_t index, std::string &) {
+        if (parsers[index].front() != '[')
+            return false;
+        downloaded[index].push_back(parsers[index].finish());
+        return true;
+    }, &parsers);
+
+    // Get album cover images of the downloaded lyrics, left empty if they fail
+    std::vector<std::string> albumIds, albumInfoUrls;
+    std::map<std::string, std::string> coverMap;
+    for (size_t i = 0; i < downloaded.size(); ++i) {
+        const std::string &albumId = candidates[i].providerData;
+        if (!downloaded[i].empty() && std::find(albumIds.begin(), albumIds.end(), albumId) == albumIds.end()) {
+            albumIds.push_back(albumId);
+            albumInfoUrls.push_back("http://gecimi.com/api/cover/" + albumId);
         }
+    }
+    downloadBatch(albumInfoUrls, albumInfoUrls.size(), [&coverMap, &albumIds](size_t index, std::string &body) {
+        try {
+            auto albumInfo = json::parse(body);
+            coverMap[albumIds[index]] = albumInfo["result"]["cover"];
+            return true;
+        } catch (json::exception &e) {
+            return false;
+        }
+    });
 
-        if (!lyrics.empty())
-            appendResultCallback(std::move(lyrics));
-
-    } catch (json::exception &e) {
-        return;
+    for (size_t i = 0; i < downloaded.size(); ++i) {
+        for (CLyric &lyric: downloaded[i]) {
+            lyric.track = candidates[i].track;
+            lyric.track.coverImageUrl = coverMap[candidates[i].providerData];
+            lyric.track.duration = track.duration;
+        }
     }
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
 
-void Xiami::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
-    curl_easy_setopt(curlHandle, CURLOPT_POST, 1);
-    curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, "");
+std::vector<CLyricCandidate> Xiami::searchCandidates(const Track &track) {
     curl_easy_setopt(curlHandle, CURLOPT_REFERER, "http://h.xiami.com/");
 
     std::string url = "http://api.xiami.com/web?v=2.0&r=search%2Fsongs&limit=10";
     url.append("&key=").append(normalizeName(track.title + " " + track.artist, true));
     url.append("&app_key=1");
 
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
+    CURLcode curlResult = performRequest(url, "");
 
     if (curlResult != CURLE_OK)
-        return;
+        return {};
 
+    std::vector<CLyricCandidate> candidates;
     try {
         auto searchResult = json::parse(response);
-        std::vector<XiamiResult> results;
-        std::vector<CLyric> lyrics;
+        MatchKey titleKey(track.title), artistKey(track.artist);
 
         for (const auto &songItem : searchResult["data"]["songs"]) {
-            results.emplace_back(songItem["song_name"], songItem["album_name"], songItem["artist_name"],
-                                 songItem["album_logo"], songItem["lyric"], track.title, track.artist);
-        }
-
-        std::stable_sort(results.begin(), results.end(),
-                         [](const XiamiResult &res1, const XiamiResult &res2) {
-                             return res1.distance < res2.distance;
-                         });
-
-        curl_easy_setopt(curlHandle, CURLOPT_POST, 0);
-
-        int count = 0;
-        for (const auto &result: results) {
-            curl_easy_setopt(curlHandle, CURLOPT_URL, result.lyricUrl.c_str());
-            response.clear();
-            if (curl_easy_perform(curlHandle) != CURLE_OK)
-                continue;
-
-            lyrics.emplace_back(response,
-                                Track(result.title, result.album, result.artist,
-                                      result.coverImageUrl, "Xiami", track.duration), LyricStyle::XiamiStyle);
-
-            if (++count > 5) break;
+            candidates.push_back(candidate(Track(songItem["song_name"], songItem["album_name"],
+                                                 songItem["artist_name"], songItem["album_logo"], "Xiami"),
+                                           songItem["lyric"], titleKey, artistKey));
         }
-
-        if (!lyrics.empty())
-            appendResultCallback(std::move(lyrics));
+        selectCandidates(candidates, titleKey, artistKey);
+        cacheResponse(CLyricResponseCache::Kind::Search);
 
     } catch (json::exception &e) {
-        return;
+        requestFailed = true;
+        return {};
     }
+    return candidates;
 }
 
-Xiami::XiamiResult::XiamiResult(std::string title, std::string album, std::string artist, std::string coverImageUrl,
-                                std::string lyricUrl, const std::string &targetTitle, const std::string &targetArtist)
-        : title(std::move(title)), album(std::move(album)), artist(std::move(artist)),
-          coverImageUrl(std::move(coverImageUrl)), lyricUrl(std::move(lyricUrl)) {
-    distance = stringDistance(this->title, targetTitle) + stringDistance(this->artist, targetArtist) / 2;
+std::vector<CLyric> Xiami::downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) {
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<CLyricStreamParser> parsers(urls.size(), CLyricStreamParser(LyricStyle::XiamiStyle));
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&](size_t index, std::string &) {
+        downloaded[index].push_back(parsers[index].finish());
+        downloaded[index].back().track = candidates[index].track;
+        downloaded[index].back().track.duration = track.duration;
+        return true;
+    }, &parsers);
+
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
 
-void Kugou::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
+std::vector<CLyricCandidate> Kugou::searchCandidates(const Track &track) {
     std::string url = "http://lyrics.kugou.com/search";
     url.append("?keyword=").append(normalizeName(track.title + " " + track.artist, true));
     url.append("&duration=").append(std::to_string(track.duration * 1000));
     url.append("&client=pc&ver=1&man=yes");
 
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
+    CURLcode curlResult = performRequest(url);
 
     if (curlResult != CURLE_OK)
-        return;
+        return {};
 
+    std::vector<CLyricCandidate> candidates;
     try {
         auto searchResult = json::parse(response);
-        std::vector<KugouResult> results;
-        std::vector<CLyric> lyrics;
+        MatchKey titleKey(track.title), artistKey(track.artist);
         for (auto searchItem: searchResult["candidates"]) {
             if (searchItem["score"] < 70) // Too low, basically no relationships
                 continue;
-            results.emplace_back(searchItem["song"], searchItem["singer"], searchItem["id"], searchItem["accesskey"],
-                                 searchItem["duration"], track.title, track.artist);
-        }
-
-        std::stable_sort(results.begin(), results.end(),
-                         [](const KugouResult &res1, const KugouResult &res2) {
-                             return res1.distance < res2.distance;
-                         });
-
-        int count = 0;
-        for (const auto &result: results) {
             std::string lyricUrl = "http://lyrics.kugou.com/download";
-            lyricUrl.append("?id=").append(result.id);
-            lyricUrl.append("&accesskey=").append(result.accessKey);
+            lyricUrl.append("?id=").append(searchItem["id"].get<std::string>());
+            lyricUrl.append("&accesskey=").append(searchItem["accesskey"].get<std::string>());
             lyricUrl.append("&fmt=krc&charset=utf8&client=pc&var=1");
-
-            curl_easy_setopt(curlHandle, CURLOPT_URL, lyricUrl.c_str());
-            response.clear();
-            if (curl_easy_perform(curlHandle) != CURLE_OK)
-                continue;
-
-            auto lyricResult = json::parse(response);
-
-            std::string lyricText = decryptKrc(lyricResult["content"], true);
-            lyrics.emplace_back(lyricText, Track(result.title, "", result.artist,
-                                                 "", "Kugou", track.duration), LyricStyle::KugouStyle);
-
-            if (++count > 5) break;
+            candidates.push_back(candidate(Track(searchItem["song"], "", searchItem["singer"], "", "Kugou",
+                                                 searchItem["duration"].get<int>() / 1000),
+                                           std::move(lyricUrl), titleKey, artistKey));
         }
-
-        if (!lyrics.empty())
-            appendResultCallback(std::move(lyrics));
+        selectCandidates(candidates, titleKey, artistKey);
+        cacheResponse(CLyricResponseCache::Kind::Search);
 
     } catch (json::exception &e) {
-        return;
+        requestFailed = true;
+        return {};
     }
+    return candidates;
+}
 
+std::vector<CLyric> Kugou::downloadLyrics(const Track &, const std::vector<CLyricCandidate> &candidates) {
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&](size_t index, std::string &body) {
+        try {
+            auto lyricResult = json::parse(body);
+            std::string lyricText = decryptKrc(lyricResult["content"], true);
+            downloaded[index].emplace_back(lyricText, candidates[index].track, LyricStyle::KugouStyle);
+            return true;
+        } catch (json::exception &e) {
+            return false;
+        }
+    });
+
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
 
 std::string Kugou::decryptKrc(const std::string &krcString, bool base64Parse) {
@@ -338,230 +493,205 @@ std::string Kugou::decryptKrc(const std::string &krcString, bool base64Parse) {
     return std::string();
 }
 
-Kugou::KugouResult::KugouResult(std::string title, std::string artist, std::string id, std::string accessKey,
-                                int duration, const std::string &targetTitle, const std::string &targetArtist)
-        : title(std::move(title)), artist(std::move(artist)), id(std::move(id)), accessKey(std::move(accessKey)),
-          duration(duration) {
-    distance = stringDistance(this->title, targetTitle) + stringDistance(this->artist, targetArtist) / 2;
-}
-
-void QQMusic::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
+std::vector<CLyricCandidate> QQMusic::searchCandidates(const Track &track) {
     std::string url = "http://c.y.qq.com/soso/fcgi-bin/client_search_cp";
     url.append("?w=").append(normalizeName(track.title + "+" + track.artist, true));
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
+    CURLcode curlResult = performRequest(url);
 
     if (curlResult != CURLE_OK)
-        return;
+        return {};
 
+    std::vector<CLyricCandidate> candidates;
     try {
-        std::vector<CLyric> lyrics;
-        std::vector<QQMusicResult> results;
+        MatchKey titleKey(track.title), artistKey(track.artist);
 
-        response = response.substr(9, response.length() - 10); // remove "callback( {...} )"
-        auto searchResult = json::parse(response);
+        auto searchResult = json::parse(response.substr(9, response.length() - 10)); // remove "callback( {...} )"
 
         for (const auto &searchItem: searchResult["data"]["song"]["list"]) {
-            results.emplace_back(searchItem["songname"], searchItem["singer"][0]["name"], searchItem["albumname"],
-                                 searchItem["songmid"], searchItem["albumid"], searchItem["interval"], track.title,
-                                 track.artist);
-        }
-
-        std::stable_sort(results.begin(), results.end(),
-                         [](const QQMusicResult &res1, const QQMusicResult &res2) {
-                             return res1.distance < res2.distance;
-                         });
+            int albumId = searchItem["albumid"];
+            std::string coverImageUrl = "http://imgcache.qq.com/music/photo/album/";
+            coverImageUrl.append(std::to_string(albumId % 100)).append("/albumpic_").append(
+                    std::to_string(albumId)).append("_0.jpg");
 
-        curl_easy_setopt(curlHandle, CURLOPT_REFERER, "http://y.qq.com/portal/player.html");
-        int count = 0;
-        for (const auto &result: results) {
             std::string lyricURL = "http://c.y.qq.com/lyric/fcgi-bin/fcg_query_lyric_new.fcg";
-            lyricURL.append("?songmid=").append(result.songmid);
+            lyricURL.append("?songmid=").append(searchItem["songmid"].get<std::string>());
             lyricURL.append("&g_tk=").append("5381");
-            curl_easy_setopt(curlHandle, CURLOPT_URL, lyricURL.c_str());
-            response.clear();
-            curlResult = curl_easy_perform(curlHandle);
 
-            if (curlResult != CURLE_OK)
-                continue;
+            candidates.push_back(candidate(Track(searchItem["songname"], searchItem["albumname"],
+                                                 searchItem["singer"][0]["name"], coverImageUrl, "QQMusic",
+                                                 searchItem["interval"]), std::move(lyricURL), titleKey, artistKey));
+        }
+        selectCandidates(candidates, titleKey, artistKey);
+        cacheResponse(CLyricResponseCache::Kind::Search);
 
-            response = response.substr(18, response.length() - 19); // remove "(MusicJsonCallback {...} )"
-            auto lyricResponse = json::parse(response);
+    } catch (json::exception &e) {
+        requestFailed = true;
+        return {};
+    }
+    return candidates;
+}
 
+std::vector<CLyric> QQMusic::downloadLyrics(const Track &, const std::vector<CLyricCandidate> &candidates) {
+    curl_easy_setopt(curlHandle, CURLOPT_REFERER, "http://y.qq.com/portal/player.html");
+
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&](size_t index, std::string &body) {
+        if (body.size() < 19)
+            return false;
+        json lyricResponse;
+        try {
+            lyricResponse = json::parse(body.substr(18, body.length() - 19)); // remove "(MusicJsonCallback {...} )"
             if (lyricResponse["lyric"].is_null())
-                continue;
+                return false;
+        } catch (json::exception &e) {
+            return false;
+        }
 
-            std::string lyric = lyricResponse["lyric"];
+        std::string lyric = lyricResponse["lyric"];
 
-            if (lyric.empty())
-                continue;
+        if (lyric.empty())
+            return false;
 
-            std::string coverImageUrl = "http://imgcache.qq.com/music/photo/album/";
-            coverImageUrl.append(std::to_string(result.albumid % 100)).append("/albumpic_").append(
-                    std::to_string(result.albumid)).append("_0.jpg");
-
-            std::string decodedLyric, decodedTrans;
-            macaron::Base64::Decode(lyric, decodedLyric);
-            unescapeXmlSpeChars(decodedLyric);
-            CLyric cLyric(decodedLyric,
-                          Track(
-                                  result.title, result.album, result.artist, coverImageUrl,
-                                  "QQMusic", result.duration
-                                  ),
-                          LyricStyle::CLrcStyle);
-
-            if (!lyricResponse["trans"].is_null()) {
-                std::string trans = lyricResponse["trans"];
-                if (trans.empty())
-                    goto emptyTransBreak;
+        std::string decodedLyric, decodedTrans;
+        macaron::Base64::Decode(lyric, decodedLyric);
+        unescapeXmlSpeChars(decodedLyric);
+        CLyric cLyric(decodedLyric, candidates[index].track, LyricStyle::CLrcStyle);
+
+        if (!lyricResponse["trans"].is_null()) {
+            std::string trans = lyricResponse["trans"];
+            if (!trans.empty()) {
                 macaron::Base64::Decode(trans, decodedTrans);
                 unescapeXmlSpeChars(decodedTrans);
                 CLyric transLyric = CLyric(decodedTrans, LyricStyle::CLrcStyle);
                 cLyric.mergeTranslation(transLyric);
             }
-
-emptyTransBreak:
-            if (cLyric.lyrics.size() == 1 && cLyric.lyrics[0].content == "此歌曲为没有填词的纯音乐，请您欣赏") {
-                cLyric.track.instrumental = true;
-                cLyric.lyrics.clear();
-            }
-            lyrics.push_back(cLyric);
-
-            if (++count > 5) break;
         }
 
-        if (!lyrics.empty())
-            appendResultCallback(std::move(lyrics));
-
-    } catch (json::exception &e) {
-        return;
-    }
-}
+        if (cLyric.lyrics.size() == 1 && cLyric.lyrics[0].content == "此歌曲为没有填词的纯音乐，请您欣赏") {
+            cLyric.track.instrumental = true;
+            cLyric.lyrics.clear();
+        }
+        downloaded[index].push_back(std::move(cLyric));
+        return true;
+    });
 
-QQMusic::QQMusicResult::QQMusicResult(std::string title, std::string artist, std::string album, std::string songmid,
-                                      int albumid, int interval, const std::string &targetTitle,
-                                      const std::string &targetArtist)
-        : title(std::move(title)), artist(std::move(artist)), album(std::move(album)), songmid(std::move(songmid)),
-          albumid(albumid), duration(interval) {
-    distance = stringDistance(this->title, targetTitle) + stringDistance(this->artist, targetArtist) / 2;
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
 
-void Netease::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
+std::vector<CLyricCandidate> Netease::searchCandidates(const Track &track) {
     bool firstTry = true;
 
     std::string url = "http://music.163.com/api/search/pc";
     url.append("?s=").append(normalizeName(track.title + " " + track.artist, true));
     url.append("&offset=0").append("&limit=10").append("&type=1");
     curl_easy_setopt(curlHandle, CURLOPT_REFERER, "http://music.163.com/");
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
 retry:
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
+    CURLcode curlResult = performRequest(url);
 
     if (curlResult != CURLE_OK)
-        return;
+        return {};
 
+    std::vector<CLyricCandidate> candidates;
     try {
-        std::vector<CLyric> lyrics;
-        std::vector<NeteaseResult> results;
+        MatchKey titleKey(track.title), artistKey(track.artist);
         auto searchResult = json::parse(response);
 
-        if (firstTry && searchResult["code"].is_number() && searchResult["code"] != 200) {
-            firstTry = false;
-            goto retry;
+        if (searchResult["code"].is_number() && searchResult["code"] != 200) {
+            if (firstTry) {
+                firstTry = false;
+                goto retry;
+            }
+            // Still an error, which must neither be cached nor taken for finding nothing
+            requestFailed = true;
+            return {};
         }
 
         for (auto &searchItem: searchResult["result"]["songs"]) {
-            results.emplace_back(searchItem["name"], searchItem["artists"][0]["name"], searchItem["album"]["name"],
-                                 searchItem["album"]["picUrl"], searchItem["id"], searchItem["duration"], track.title,
-                                 track.artist);
-        }
-
-        std::stable_sort(results.begin(), results.end(),
-                         [](const NeteaseResult &res1, const NeteaseResult &res2) {
-                             return res1.distance < res2.distance;
-                         });
-
-        int count = 0;
-        for (const auto &result: results) {
             std::string lyricURL = "http://music.163.com/api/song/lyric";
-            lyricURL.append("?id=").append(std::to_string(result.id));
+            lyricURL.append("?id=").append(std::to_string(searchItem["id"].get<int>()));
             lyricURL.append("&lv=1").append("&kv=1").append("&tv=-1");
-            curl_easy_setopt(curlHandle, CURLOPT_URL, lyricURL.c_str());
-            response.clear();
-            curlResult = curl_easy_perform(curlHandle);
+            candidates.push_back(candidate(Track(searchItem["name"], searchItem["album"]["name"],
+                                                 searchItem["artists"][0]["name"], searchItem["album"]["picUrl"],
+                                                 "Netease", searchItem["duration"].get<int>() / 1000),
+                                           std::move(lyricURL), titleKey, artistKey));
+        }
+        selectCandidates(candidates, titleKey, artistKey);
+        cacheResponse(CLyricResponseCache::Kind::Search);
 
-            if (curlResult != CURLE_OK)
-                continue;
+    } catch (json::exception &e) {
+        requestFailed = true;
+        return {};
+    }
+    return candidates;
+}
 
-            auto lyricResult = json::parse(response);
+std::vector<CLyric> Netease::downloadLyrics(const Track &, const std::vector<CLyricCandidate> &candidates) {
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&](size_t index, std::string &body) {
+        const CLyricCandidate &result = candidates[index];
+        try {
+            auto lyricResult = json::parse(body);
 
             if (result.distance == 0 && !lyricResult["nolyric"].is_null() && lyricResult["nolyric"]) {
-                CLyric cLyric = CLyric(
-                        Track(result.title, result.album, result.artist,
-                              result.coverImageUrl, "Netease", result.duration, true), std::vector<CLyricItem>());
-                lyrics.push_back(cLyric);
+                Track instrumentalTrack = result.track;
+                instrumentalTrack.instrumental = true;
+                downloaded[index].emplace_back(instrumentalTrack, std::vector<CLyricItem>());
             }
 
             if (lyricResult["lrc"]["lyric"].is_null())
-                continue;
-            CLyric cLyric = CLyric(lyricResult["lrc"]["lyric"],
-                                   Track(result.title, result.album, result.artist,
-                                         result.coverImageUrl, "Netease", result.duration), LyricStyle::CLrcStyle);
+                return false;
+            CLyric cLyric = CLyric(lyricResult["lrc"]["lyric"], result.track, LyricStyle::CLrcStyle);
 
             if (!lyricResult["tlyric"]["lyric"].is_null()) {
                 CLyric trans = CLyric(lyricResult["tlyric"]["lyric"], LyricStyle::CLrcStyle);
                 cLyric.mergeTranslation(trans);
             }
 
-            lyrics.push_back(cLyric);
-
-            if (++count > 5) break;
+            downloaded[index].push_back(std::move(cLyric));
+            return true;
+        } catch (json::exception &e) {
+            return false;
         }
+    });
 
-        if (!lyrics.empty())
-            appendResultCallback(std::move(lyrics));
-
-    } catch (json::exception &e) {
-        return;
-    }
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
 
-Netease::NeteaseResult::NeteaseResult(std::string title, std::string artist, std::string album,
-                                      std::string coverImageUrl, int id, int duration, const std::string &targetTitle,
-                                      const std::string &targetArtist)
-        : title(std::move(title)), artist(std::move(artist)), album(std::move(album)),
-          coverImageUrl(std::move(coverImageUrl)), id(id), duration(duration / 1000) {
-    distance = stringDistance(this->title, targetTitle) + stringDistance(this->artist, targetArtist) / 2;
-}
-
-void THBWiki::searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) {
-    long responseCode;
-
+std::vector<CLyricCandidate> THBWiki::searchCandidates(const Track &track) {
+    // The wiki has no search API, the lyric named after the title is the only candidate
     std::string url = "https://cd.thwiki.cc/lyrics/";
     url.append(normalizeName(trim_copy(track.title), true)).append(".all.lrc");
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    response.clear();
-    CURLcode curlResult = curl_easy_perform(curlHandle);
-
-    if (curlResult != CURLE_OK)
-        return;
-    curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &responseCode);
-
-    if (responseCode != 200)
-        return;
-
-    std::regex transPattern(R"((\[.*\])(.*) *\/\/ *(.*))");
-    std::string lyric = std::regex_replace(response, transPattern, "$1$2\n$1[tr]$3");
-
-    std::regex tagPattern(R"(\[(ti|ar|al):(.*)\])");
-    std::string lyricContent = std::regex_replace(lyric, tagPattern, "[$1]$2");
-
-    CLyric cLyric(lyricContent, CLrcStyle);
-    cLyric.track.source = "THBWiki";
-
-    std::vector<CLyric> lyrics = {cLyric};
+    // The page does not tell the artist, so the wanted one is assumed and only the title is weighed
+    MatchKey titleKey(track.title), artistKey(track.artist);
+    std::vector<CLyricCandidate> candidates;
+    candidates.push_back(candidate(Track(track.title, "", track.artist, "", "THBWiki"), url, titleKey, artistKey));
+    selectCandidates(candidates, titleKey, artistKey);
+    return candidates;
+}
 
-    appendResultCallback(lyrics);
+std::vector<CLyric> THBWiki::downloadLyrics(const Track &, const std::vector<CLyricCandidate> &candidates) {
+    std::vector<std::string> urls = lyricUrls(candidates);
+    std::vector<std::vector<CLyric>> downloaded(urls.size());
+    downloadBatch(urls, urls.size(), [&downloaded](size_t index, std::string &body) {
+        std::regex transPattern(R"((\[.*\])(.*) *\/\/ *(.*))");
+        std::string lyric = std::regex_replace(body, transPattern, "$1$2\n$1[tr]$3");
+
+        std::regex tagPattern(R"(\[(ti|ar|al):(.*)\])");
+        std::string lyricContent = std::regex_replace(lyric, tagPattern, "[$1]$2");
+
+        CLyric cLyric(lyricContent, CLrcStyle);
+        cLyric.track.source = "THBWiki";
+        downloaded[index].push_back(std::move(cLyric));
+        return true;
+    });
+
+    std::vector<CLyric> lyrics;
+    appendInOrder(downloaded, lyrics);
+    return lyrics;
 }
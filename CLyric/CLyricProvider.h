@@ -11,7 +11,12 @@
 #endif
 
 #include "CLyric.h"
+#include "CLyricCancellation.h"
+#include "CLyricParser.h"
+#include "CLyricResponseCache.h"
+#include "CLyricUtils.h"
 #include <curl/curl.h>
+#include <chrono>
 #include <cstdint>
 #include <utility>
 #include <map>
@@ -19,85 +24,134 @@
 
 namespace cLyric {
 
+    // A search hit of a provider, ranked against the hits of all providers before its lyric is downloaded
+    struct CLyricCandidate {
+        Track track;              // Metadata of the hit, the duration is -1 if the provider does not tell
+        std::string lyricUrl;
+        std::string providerData; // Kept for downloadLyrics, the album id for Gecimi
+        int distance = INT_MAX;   // trackDistance to the searched track
+        size_t provider = 0;      // Index of the provider in CLyricSearch
+    };
+
     class CLyricProvider {
     protected:
         CURL *curlHandle;
+        CURLM *multiHandle;
         std::string response;
+        CLyricCancellation cancellation;
+        long responseCode = 0;
+        size_t transfers = 0;
+        uint64_t transferredBytes = 0;
+
+        // Request of the last performRequest, and whether response came from the response cache
+        std::string requestUrl, requestBody;
+        bool cachedResponse = false, requestFailed = false;
 
         CLyricProvider();
 
         static size_t storeCURLResponse(void *buffer, size_t size, size_t nmemb, void *userp);
 
+        // Requests url with curlHandle into response and responseCode, POSTing postFields if given.
+        // A response stored by cacheResponse is loaded from the response cache instead.
+        // Sets requestFailed if the transfer failed or the server answered with an error.
+        CURLcode performRequest(const std::string &url, const char *postFields = nullptr);
+
+        // Stores the response of the last performRequest in the response cache, once it has been parsed
+        void cacheResponse(CLyricResponseCache::Kind kind);
+
+        // Counts a completed transfer of handle into transferCount and transferBytes
+        void countTransfer(CURL *handle);
+
+        // Progress callback of every transfer, aborts it once the search is cancelled or out of time
+        static int abortStoppedTransfer(void *userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+
+        // Called for every completed download of downloadBatch, returns whether it produced a result
+        using BatchHandler = std::function<bool(size_t index, std::string &body)>;
+
+        // GETs urls concurrently with the options of curlHandle. Only as many downloads run as results are
+        // missing to reach maxResults, one which fails, gets an HTTP error or yields no result starts the next
+        // url in order. handler runs on this thread as each download completes. With parsers, the body of
+        // urls[i] is fed into parsers[i] as it arrives instead of being passed to handler. Returns early once the
+        // search is stopped, with handler called for the downloads completed until then. Downloads are served
+        // from the response cache if it has them, and stored in it when handler accepts them.
+        void downloadBatch(const std::vector<std::string> &urls, size_t maxResults, const BatchHandler &handler,
+                           std::vector<CLyricStreamParser> *parsers = nullptr);
+
+        static CLyricCandidate candidate(Track track, std::string lyricUrl, const MatchKey &targetTitle,
+                                         const MatchKey &targetArtist);
+
+        // Sorts candidates by distance and keeps the closest maxCandidates within maxTrackDistance
+        static void selectCandidates(std::vector<CLyricCandidate> &candidates, const MatchKey &targetTitle,
+                                     const MatchKey &targetArtist);
+
     public:
+        static constexpr size_t maxCandidates = 6; // Candidates returned per provider
+
         virtual ~CLyricProvider();
 
-        void normalizeName(std::string &str, bool isHttpParam = false, bool noSpecialChars = true);
+        // Limit of concurrent downloadBatch connections to one host, 4 by default
+        void setMaxHostConnections(long connections);
+
+        // Name of the provider, as in Track::source of its lyrics
+        [[nodiscard]] virtual const char *name() const = 0;
+
+        // Limit of every transfer from then on, including connecting
+        void setTimeout(std::chrono::milliseconds timeout);
+
+        // Whether the last search request failed or its response was no search result, which searchCandidates
+        // does not tell apart from finding nothing
+        [[nodiscard]] bool lastRequestFailed() const { return requestFailed; }
+
+        // Whether the response of the last request was loaded from the response cache
+        [[nodiscard]] bool lastResponseCached() const { return cachedResponse; }
+
+        // Token checked by every transfer, a stopped provider returns what it already has
+        void setCancellation(CLyricCancellation token) { cancellation = std::move(token); }
 
-        std::string normalizeName(const std::string &str, bool isHttpParam = false, bool noSpecialChars = true);
+        // Running totals of the completed network transfers, responses loaded from the cache are not counted
+        [[nodiscard]] size_t transferCount() const { return transfers; }
 
-        virtual void
-        searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) = 0;
+        [[nodiscard]] uint64_t transferBytes() const { return transferredBytes; }
+
+        // Metadata phase: sends the search request only and returns the hits worth downloading, best first
+        virtual std::vector<CLyricCandidate> searchCandidates(const Track &track) = 0;
+
+        // Content phase: downloads the lyrics of candidates returned by searchCandidates of this provider,
+        // in the order of candidates. Failed downloads are left out.
+        virtual std::vector<CLyric> downloadLyrics(const Track &track,
+                                                   const std::vector<CLyricCandidate> &candidates) = 0;
     };
 
     class Gecimi : public CLyricProvider {
-
     public:
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
-    };
+        [[nodiscard]] const char *name() const override { return "Gecimi"; }
 
-    class Xiami : public CLyricProvider {
-        struct XiamiResult {
-            XiamiResult(std::string title, std::string album, std::string artist, std::string coverImageUrl,
-                        std::string lyricUrl) : title(std::move(title)),
-                                                album(std::move(album)), artist(std::move(artist)),
-                                                coverImageUrl(std::move(coverImageUrl)),
-                                                lyricUrl(std::move(lyricUrl)), distance(INT_MAX) {}
-
-            XiamiResult(std::string title, std::string album, std::string artist, std::string coverImageUrl,
-                        std::string lyricUrl,
-                        const std::string &targetTitle, const std::string &targetArtist);
-
-            std::string title, album, artist, coverImageUrl, lyricUrl;
-            int distance;
-        };
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
 
-    public:
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
     };
 
-    class Kugou : public CLyricProvider {
-        struct KugouResult {
-            KugouResult(std::string title, std::string artist, std::string id, std::string accessKey,
-                        int duration) : title(std::move(title)), artist(std::move(artist)), id(std::move(id)),
-                                        accessKey(std::move(accessKey)), duration(duration), distance(INT_MAX) {}
+    class Xiami : public CLyricProvider {
+    public:
+        [[nodiscard]] const char *name() const override { return "Xiami"; }
 
-            KugouResult(std::string title, std::string artist, std::string id, std::string accessKey,
-                        int duration, const std::string &targetTitle, const std::string &targetArtist);
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
 
-            std::string title, artist, id, accessKey;
-            int duration, distance;
-        };
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
+    };
 
+    class Kugou : public CLyricProvider {
         static std::string decryptKrc(const std::string &krcString, bool base64Parse = false);
 
     public:
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
-    };
-
-    class QQMusic : public CLyricProvider {
-        struct QQMusicResult {
-            QQMusicResult(std::string title, std::string artist, std::string album, std::string songmid,
-                          int albumid, int interval) : title(std::move(title)), artist(std::move(artist)),
-                                                       album(std::move(album)), songmid(std::move(songmid)),
-                                                       albumid(albumid), duration(interval), distance(INT_MAX) {}
+        [[nodiscard]] const char *name() const override { return "Kugou"; }
 
-            QQMusicResult(std::string title, std::string artist, std::string album, std::string songmid, int albumid,
-                          int interval, const std::string &targetTitle, const std::string &targetArtist);
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
 
-            std::string title, artist, album, songmid;
-            int albumid, duration, distance;
-        };
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
+    };
 
+    class QQMusic : public CLyricProvider {
         std::map<std::string, std::string> xmlSpecialChars = {
                 {"&amp;",  "&"},
                 {"&lt;",   "<"},
@@ -116,34 +170,29 @@ namespace cLyric {
     public:
 //    QQMusic(opencc::SimpleConverter& converter) : converter(converter) {}
 
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
+        [[nodiscard]] const char *name() const override { return "QQMusic"; }
+
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
+
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
     };
 
     class Netease : public CLyricProvider {
-        struct NeteaseResult {
-            NeteaseResult(std::string title, std::string artist, std::string album,
-                          std::string coverImageUrl, int id, int duration) : title(std::move(title)),
-                                                                             artist(std::move(artist)),
-                                                                             album(std::move(album)),
-                                                                             coverImageUrl(std::move(coverImageUrl)),
-                                                                             id(id), duration(duration / 1000),
-                                                                             distance(INT_MAX) {}
-
-            NeteaseResult(std::string title, std::string artist, std::string album, std::string coverImageUrl, int id,
-                          int duration,
-                          const std::string &targetTitle, const std::string &targetArtist);
-
-            std::string title, artist, album, coverImageUrl;
-            int id, duration, distance;
-        };
-
     public:
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
+        [[nodiscard]] const char *name() const override { return "Netease"; }
+
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
+
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
     };
 
     class THBWiki : public CLyricProvider {
     public:
-        void searchLyrics(const Track &track, std::function<void(std::vector<CLyric>)> appendResultCallback) override;
+        [[nodiscard]] const char *name() const override { return "THBWiki"; }
+
+        std::vector<CLyricCandidate> searchCandidates(const Track &track) override;
+
+        std::vector<CLyric> downloadLyrics(const Track &track, const std::vector<CLyricCandidate> &candidates) override;
     };
 
 }
@@ -0,0 +1,148 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricProviderHealth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace cLyric;
+
+namespace {
+
+    int64_t secondsSinceEpoch() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+}
+
+int CLyricProviderStats::latencyPercentile(double percentile) const {
+    if (latencies.empty())
+        return -1;
+    std::vector<int> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = static_cast<size_t>(std::ceil(percentile / 100 * double(sorted.size())));
+    return sorted[std::min(sorted.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+CLyricProviderHealth &CLyricProviderHealth::instance() {
+    static CLyricProviderHealth health;
+    return health;
+}
+
+bool CLyricProviderHealth::open(const std::string &filePath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->filePath = filePath;
+    providers.clear();
+
+    std::ifstream file(std::filesystem::u8path(filePath));
+    if (!file.is_open())
+        return false;
+    // Lines are "name attempts successes chosen consecutiveFailures openUntil openDuration count latencies..."
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        CLyricProviderStats stats;
+        size_t count;
+        if (!(fields >> name >> stats.attempts >> stats.successes >> stats.chosen >> stats.consecutiveFailures >>
+                     stats.openUntil >> stats.openDuration >> count))
+            continue;
+        int latency;
+        while (stats.latencies.size() < std::min(count, CLyricProviderStats::latencySamples) && fields >> latency)
+            stats.latencies.push_back(latency);
+        providers[name] = std::move(stats);
+    }
+    return true;
+}
+
+bool CLyricProviderHealth::save() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (filePath.empty())
+        return false;
+
+    std::ofstream file(std::filesystem::u8path(filePath), std::ios::out | std::ios::trunc);
+    for (const auto &[name, stats]: providers) {
+        file << name << ' ' << stats.attempts << ' ' << stats.successes << ' ' << stats.chosen << ' '
+             << stats.consecutiveFailures << ' ' << stats.openUntil << ' ' << stats.openDuration << ' '
+             << stats.latencies.size();
+        for (int latency: stats.latencies)
+            file << ' ' << latency;
+        file << '\n';
+    }
+    return file.good();
+}
+
+bool CLyricProviderHealth::allowRequest(const std::string &provider) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CLyricProviderStats &stats = providers[provider];
+    if (stats.consecutiveFailures < failureThreshold)
+        return true;
+    if (secondsSinceEpoch() < stats.openUntil || stats.probing)
+        return false;
+    stats.probing = true;
+    return true;
+}
+
+void CLyricProviderHealth::recordResult(const std::string &provider, bool success,
+                                        std::chrono::milliseconds latency) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CLyricProviderStats &stats = providers[provider];
+    bool probe = stats.probing;
+    stats.probing = false;
+    ++stats.attempts;
+
+    if (success) {
+        ++stats.successes;
+        stats.consecutiveFailures = 0;
+        stats.openDuration = 0;
+        stats.latencies.push_back(static_cast<int>(latency.count()));
+        if (stats.latencies.size() > CLyricProviderStats::latencySamples)
+            stats.latencies.erase(stats.latencies.begin());
+        return;
+    }
+
+    ++stats.consecutiveFailures;
+    if (probe || stats.consecutiveFailures == failureThreshold) {
+        int64_t first = std::chrono::seconds(firstOpenDuration).count();
+        int64_t max = std::chrono::seconds(maxOpenDuration).count();
+        stats.openDuration = probe ? std::min(max, std::max(first, stats.openDuration * 2)) : first;
+        stats.openUntil = secondsSinceEpoch() + stats.openDuration;
+    }
+}
+
+void CLyricProviderHealth::recordCancelled(const std::string &provider) {
+    std::lock_guard<std::mutex> lock(mutex);
+    providers[provider].probing = false;
+}
+
+void CLyricProviderHealth::recordChosen(const std::string &provider) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++providers[provider].chosen;
+}
+
+std::chrono::milliseconds CLyricProviderHealth::timeout(const std::string &provider) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto stats = providers.find(provider);
+    if (stats == providers.end() || stats->second.latencies.size() < minLatencySamples)
+        return maxTimeout;
+    std::chrono::milliseconds timeout(3 * stats->second.latencyPercentile(90));
+    return std::clamp<std::chrono::milliseconds>(timeout, minTimeout, maxTimeout);
+}
+
+double CLyricProviderHealth::score(const std::string &provider) const {
+    CLyricProviderStats stats = statistics(provider);
+    return stats.successRate() * (1 + stats.chosenRate());
+}
+
+CLyricProviderStats CLyricProviderHealth::statistics(const std::string &provider) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto stats = providers.find(provider);
+    return stats == providers.end() ? CLyricProviderStats() : stats->second;
+}
@@ -0,0 +1,92 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICPROVIDERHEALTH_H
+#define CRYSTALLYRICS_CLYRICPROVIDERHEALTH_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cLyric {
+
+    struct CLyricProviderStats {
+        static constexpr size_t latencySamples = 64;
+
+        uint64_t attempts = 0, successes = 0;
+        uint64_t chosen = 0;         // Searches whose chosen lyric came from the provider
+        int consecutiveFailures = 0;
+        int64_t openUntil = 0;       // in seconds since the epoch, the circuit is open before it
+        int64_t openDuration = 0;    // in seconds, of the last time the circuit opened
+        bool probing = false;        // A half-open probe is running, not saved
+        std::vector<int> latencies;  // of the last successful requests in milliseconds, oldest first
+
+        // Smoothed, so a provider without attempts starts at 0.5
+        [[nodiscard]] double successRate() const { return double(successes + 1) / double(attempts + 2); }
+
+        [[nodiscard]] double chosenRate() const { return successes > 0 ? double(chosen) / double(successes) : 0; }
+
+        // Latency below which percentile of the samples lie, in milliseconds, -1 without samples
+        [[nodiscard]] int latencyPercentile(double percentile) const;
+    };
+
+    // Running statistics of the search requests of every provider, by provider name. They order the providers,
+    // time-box their requests by the observed latency, and break the circuit of providers which keep failing:
+    // after failureThreshold failures in a row a provider is skipped, until a single probe request is let
+    // through once the open duration has passed. A failed probe doubles the open duration.
+    class CLyricProviderHealth {
+        mutable std::mutex mutex;
+        std::map<std::string, CLyricProviderStats> providers;
+        std::string filePath;
+
+    public:
+        static constexpr int failureThreshold = 3;
+        static constexpr auto firstOpenDuration = std::chrono::minutes(5);
+        static constexpr auto maxOpenDuration = std::chrono::hours(6);
+        static constexpr auto minTimeout = std::chrono::seconds(2);
+        static constexpr auto maxTimeout = std::chrono::seconds(10);
+        static constexpr size_t minLatencySamples = 5; // before the timeout adapts
+
+        CLyricProviderHealth() = default;
+
+        CLyricProviderHealth(const CLyricProviderHealth &) = delete;
+
+        CLyricProviderHealth &operator=(const CLyricProviderHealth &) = delete;
+
+        // The statistics of all searches
+        static CLyricProviderHealth &instance();
+
+        // Loads the statistics saved in the file, which save writes to from then on
+        bool open(const std::string &filePath);
+
+        bool save() const;
+
+        // Whether the provider may be queried now, lets one probe through when its circuit is half-open
+        bool allowRequest(const std::string &provider);
+
+        void recordResult(const std::string &provider, bool success, std::chrono::milliseconds latency);
+
+        // The request was given up for a reason of the caller or never sent, it neither counts as a success nor
+        // a failure. Ends a half-open probe, so the next request may probe again.
+        void recordCancelled(const std::string &provider);
+
+        void recordChosen(const std::string &provider);
+
+        // Three times the 90th percentile latency within minTimeout and maxTimeout, maxTimeout until there are
+        // enough samples
+        [[nodiscard]] std::chrono::milliseconds timeout(const std::string &provider) const;
+
+        // Higher for providers which answer and whose lyrics get chosen
+        [[nodiscard]] double score(const std::string &provider) const;
+
+        [[nodiscard]] CLyricProviderStats statistics(const std::string &provider) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICPROVIDERHEALTH_H
@@ -0,0 +1,67 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricRanker.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <numeric>
+
+using namespace cLyric;
+
+CLyricRanker::CLyricRanker(const std::string &title, const std::string &artist, int duration)
+        : title(title), artist(artist), duration(duration) {
+    length = std::max(1, maxTrackDistance(this->title, this->artist));
+}
+
+CLyricScore CLyricRanker::score(const Track &track) const {
+    CLyricScore score;
+    // Not bounded like trackDistance, so results too far off still order among themselves
+    score.distance = matchDistance(MatchKey(track.title), title) + matchDistance(MatchKey(track.artist), artist) / 2;
+    score.valid = true;
+    if (duration > 0)
+        score.durationDelta = track.duration > 0 ? std::abs(track.duration - duration) : INT_MAX;
+    score.score = 1 - double(score.distance) / length;
+    return score;
+}
+
+CLyricScore CLyricRanker::score(const CLyric &lyric) const {
+    CLyricScore score = this->score(lyric.track);
+    for (const CLyricItem &item: lyric.lyrics) {
+        score.hasTranslation = score.hasTranslation || !item.translation.empty();
+        score.hasTimecodes = score.hasTimecodes || !item.timecodes.empty();
+        if (score.hasTranslation && score.hasTimecodes)
+            break;
+    }
+    score.valid = lyric.isValid();
+
+    if (score.hasTranslation)
+        score.score += 0.2;
+    if (score.hasTimecodes)
+        score.score += 0.1;
+    if (!score.valid)
+        score.score -= 1;
+    return score;
+}
+
+void CLyricRanker::rank(std::vector<CLyric> &lyrics) const {
+    std::vector<CLyricScore> scores;
+    scores.reserve(lyrics.size());
+    for (const CLyric &lyric: lyrics)
+        scores.push_back(score(lyric));
+
+    std::vector<size_t> order(lyrics.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&scores](size_t index1, size_t index2) {
+        return better(scores[index1], scores[index2]);
+    });
+
+    std::vector<CLyric> ranked;
+    ranked.reserve(lyrics.size());
+    for (size_t index: order)
+        ranked.push_back(std::move(lyrics[index]));
+    lyrics = std::move(ranked);
+}
@@ -0,0 +1,58 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICRANKER_H
+#define CRYSTALLYRICS_CLYRICRANKER_H
+
+#include "CLyric.h"
+#include "CLyricUtils.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace cLyric {
+
+    struct CLyricScore {
+        int distance = 0;      // Title distance plus half the artist distance, in code points
+        bool hasTranslation = false, hasTimecodes = false, valid = false;
+        int durationDelta = 0; // in seconds, INT_MAX if the duration of the result is unknown
+        double score = 0;      // Higher is better
+    };
+
+    // Orders search results by how well they match the searched track.
+    // Every result is scored once, sorting compares the precomputed scores only.
+    class CLyricRanker {
+        MatchKey title, artist;
+        int duration;      // in seconds, not compared if not positive
+        int length;        // Distance at which the title part of the score reaches 0
+
+    public:
+        CLyricRanker(const std::string &title, const std::string &artist, int duration = -1);
+
+        // Score of the metadata alone, as known from a search hit before its lyric is downloaded
+        [[nodiscard]] CLyricScore score(const Track &track) const;
+
+        [[nodiscard]] CLyricScore score(const CLyric &lyric) const;
+
+        // Whether the duration of track is within tolerance seconds of the searched one, or either is unknown
+        [[nodiscard]] bool durationMatches(const Track &track, int tolerance) const {
+            return duration <= 0 || track.duration <= 0 || std::abs(track.duration - duration) <= tolerance;
+        }
+
+        // Whether score1 ranks before score2
+        [[nodiscard]] static bool better(const CLyricScore &score1, const CLyricScore &score2) {
+            if (score1.score != score2.score)
+                return score1.score > score2.score;
+            return score1.durationDelta < score2.durationDelta;
+        }
+
+        // Sorts best first, results of equal score keep their order unless one is closer in duration
+        void rank(std::vector<CLyric> &lyrics) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICRANKER_H
@@ -0,0 +1,329 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricResponseCache.h"
+#include "CLyricUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace cLyric;
+
+namespace {
+
+    constexpr const char *fileExtension = ".resp";
+    constexpr const char *temporaryExtension = ".tmp";
+
+    std::string lowercase(std::string_view str) {
+        std::string result(str);
+        for (char &ch: result)
+            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        return result;
+    }
+
+    std::string cacheKey(std::string_view url, std::string_view postBody) {
+        std::string key = CLyricResponseCache::normalizeUrl(url);
+        key.push_back('\n');
+        key.append(postBody);
+        return key;
+    }
+
+    // FNV-1a, the key itself is stored in the file to tell colliding requests apart
+    std::string fileName(const std::string &key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char ch: key) {
+            hash ^= ch;
+            hash *= 1099511628211ull;
+        }
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string name(16, '0');
+        for (int i = 15; i >= 0; --i, hash >>= 4u)
+            name[i] = digits[hash & 0xFu];
+        return name + fileExtension;
+    }
+
+    int64_t secondsSinceEpoch() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Numbers the temporary files, so concurrent stores of one request do not write into the same one
+    std::atomic<uint64_t> temporaryCount = 0;
+
+    void removeFiles(const std::vector<std::string> &paths) {
+        std::error_code error;
+        for (const std::string &path: paths)
+            std::filesystem::remove(std::filesystem::u8path(path), error);
+    }
+
+}
+
+CLyricResponseCache &CLyricResponseCache::instance() {
+    static CLyricResponseCache cache;
+    return cache;
+}
+
+std::string CLyricResponseCache::filePath(const std::string &fileName) const {
+    return directoryPath + "/" + fileName;
+}
+
+bool CLyricResponseCache::open(const std::string &directoryPath, uint64_t sizeBudget) {
+    std::vector<std::string> removed;
+    std::unique_lock<std::mutex> lock(mutex);
+    this->directoryPath.clear();
+    entries.clear();
+    totalSize = 0;
+
+    std::error_code error;
+    auto directory = std::filesystem::u8path(directoryPath);
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory, error))
+        return false;
+
+    for (const auto &file: std::filesystem::directory_iterator(directory, error)) {
+        if (!file.is_regular_file(error))
+            continue;
+        // Left over by a store which never got to rename it, nothing else would ever delete it
+        if (file.path().extension() == temporaryExtension) {
+            removed.push_back(file.path().u8string());
+            continue;
+        }
+        if (file.path().extension() != fileExtension)
+            continue;
+        Entry entry{file.file_size(error), file.last_write_time(error)};
+        if (error)
+            continue;
+        entries.emplace(file.path().filename().u8string(), entry);
+        totalSize += entry.size;
+    }
+
+    this->directoryPath = directoryPath;
+    this->sizeBudget = sizeBudget;
+    evict(removed);
+    lock.unlock();
+    removeFiles(removed);
+    return true;
+}
+
+void CLyricResponseCache::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    directoryPath.clear();
+    entries.clear();
+    totalSize = 0;
+}
+
+bool CLyricResponseCache::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !directoryPath.empty();
+}
+
+void CLyricResponseCache::setTimeToLive(Kind kind, std::chrono::seconds timeToLive) {
+    std::lock_guard<std::mutex> lock(mutex);
+    (kind == Kind::Search ? searchTimeToLive : contentTimeToLive) = timeToLive;
+}
+
+bool CLyricResponseCache::load(std::string_view url, std::string_view postBody, std::string &body) {
+    std::string key = cacheKey(url, postBody);
+    std::string name = fileName(key);
+    std::string path;
+    std::filesystem::file_time_type lastUse;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(name);
+        if (directoryPath.empty() || entry == entries.end())
+            return false;
+        path = filePath(name);
+        lastUse = entry->second.lastUse;
+    }
+
+    // Read and inflated without the lock, so the providers of a search do not wait for each other
+    std::ifstream file(std::filesystem::u8path(path), std::ios::in | std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    FileHeader header{};
+    bool valid = contents.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, contents.data(), sizeof(header));
+        valid = header.magic == magic && header.version == version &&
+                contents.size() - sizeof(header) >= header.keySize && header.expiryTime > secondsSinceEpoch();
+    }
+    if (valid && std::string_view(contents).substr(sizeof(header), header.keySize) != key)
+        return false; // Another request of the same hash, left to be replaced by store
+    valid = valid && zlibInflate(contents.substr(sizeof(header) + header.keySize), body) &&
+            body.size() == header.bodySize;
+
+    std::vector<std::string> removed;
+    auto useTime = std::filesystem::file_time_type::clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A store in the meantime replaced the file and the time of its entry
+        auto entry = entries.find(name);
+        if (entry != entries.end() && entry->second.lastUse == lastUse) {
+            if (valid)
+                entry->second.lastUse = useTime;
+            else
+                remove(name, removed);
+        }
+    }
+    if (!valid) {
+        body.clear();
+        removeFiles(removed);
+        return false;
+    }
+
+    // Touch the file, so the order of use survives a restart
+    std::error_code error;
+    std::filesystem::last_write_time(std::filesystem::u8path(path), useTime, error);
+    return true;
+}
+
+void CLyricResponseCache::store(std::string_view url, std::string_view postBody, Kind kind, const std::string &body) {
+    std::string key = cacheKey(url, postBody);
+    std::string name = fileName(key);
+    std::string path, temporaryPath;
+    FileHeader header{};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (directoryPath.empty())
+            return;
+        path = filePath(name);
+        temporaryPath = filePath(name + "." + std::to_string(temporaryCount++) + temporaryExtension);
+        header.expiryTime = secondsSinceEpoch() + (kind == Kind::Search ? searchTimeToLive : contentTimeToLive).count();
+    }
+
+    // Compressed and written without the lock, then renamed so a crash never leaves a truncated entry behind
+    std::string compressed;
+    if (!zlibDeflate(body, compressed))
+        return;
+    header.magic = magic;
+    header.version = version;
+    header.keySize = static_cast<uint32_t>(key.size());
+    header.bodySize = static_cast<uint32_t>(body.size());
+    bool written;
+    {
+        std::ofstream file(std::filesystem::u8path(temporaryPath), std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(key.data(), static_cast<std::streamsize>(key.size()));
+        file.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+        written = file.good();
+    }
+    std::error_code error;
+    if (!written) {
+        std::filesystem::remove(std::filesystem::u8path(temporaryPath), error);
+        return;
+    }
+    std::filesystem::rename(std::filesystem::u8path(temporaryPath), std::filesystem::u8path(path), error);
+    if (error) {
+        std::filesystem::remove(std::filesystem::u8path(temporaryPath), error);
+        return;
+    }
+
+    std::vector<std::string> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (directoryPath.empty())
+            return; // Closed in the meantime, the next open finds the file
+        auto entry = entries.find(name);
+        if (entry != entries.end())
+            totalSize -= entry->second.size;
+        Entry &newEntry = entries[name];
+        newEntry.size = sizeof(header) + key.size() + compressed.size();
+        newEntry.lastUse = std::filesystem::file_time_type::clock::now();
+        totalSize += newEntry.size;
+        evict(removed);
+    }
+    removeFiles(removed);
+}
+
+void CLyricResponseCache::clear() {
+    std::vector<std::string> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!entries.empty())
+            remove(entries.begin()->first, removed);
+    }
+    removeFiles(removed);
+}
+
+uint64_t CLyricResponseCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalSize;
+}
+
+void CLyricResponseCache::remove(const std::string &fileName, std::vector<std::string> &removed) {
+    auto entry = entries.find(fileName);
+    if (entry == entries.end())
+        return;
+    removed.push_back(filePath(fileName));
+    totalSize -= entry->second.size;
+    entries.erase(entry);
+}
+
+void CLyricResponseCache::evict(std::vector<std::string> &removed) {
+    if (totalSize <= sizeBudget)
+        return;
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> byUse;
+    byUse.reserve(entries.size());
+    for (const auto &[name, entry]: entries)
+        byUse.emplace_back(entry.lastUse, name);
+    std::sort(byUse.begin(), byUse.end());
+    for (size_t i = 0; i < byUse.size() && totalSize > sizeBudget; ++i)
+        remove(byUse[i].second, removed);
+}
+
+std::string CLyricResponseCache::normalizeUrl(std::string_view url) {
+    url = url.substr(0, url.find('#'));
+
+    size_t schemeEnd = url.find("://");
+    size_t hostBegin = schemeEnd == std::string_view::npos ? 0 : schemeEnd + 3;
+    size_t hostEnd = std::min(url.find_first_of("/?", hostBegin), url.size());
+    std::string scheme = schemeEnd == std::string_view::npos ? std::string() : lowercase(url.substr(0, schemeEnd));
+    std::string host = lowercase(url.substr(hostBegin, hostEnd - hostBegin));
+    auto dropPort = [&host](std::string_view port) {
+        if (host.size() > port.size() && host.compare(host.size() - port.size(), port.size(), port) == 0)
+            host.resize(host.size() - port.size());
+    };
+    if (scheme == "http")
+        dropPort(":80");
+    else if (scheme == "https")
+        dropPort(":443");
+
+    size_t queryBegin = std::min(url.find('?', hostEnd), url.size());
+    std::string_view path = url.substr(hostEnd, queryBegin - hostEnd);
+
+    // Parameters of the same name keep their order, it may matter to the server
+    std::vector<std::string_view> parameters;
+    std::string_view query = url.substr(std::min(queryBegin + 1, url.size()));
+    while (!query.empty()) {
+        size_t end = std::min(query.find('&'), query.size());
+        if (end > 0)
+            parameters.push_back(query.substr(0, end));
+        query.remove_prefix(std::min(end + 1, query.size()));
+    }
+    auto name = [](std::string_view parameter) { return parameter.substr(0, parameter.find('=')); };
+    std::stable_sort(parameters.begin(), parameters.end(), [&name](std::string_view parameter1,
+                                                                 std::string_view parameter2) {
+        return name(parameter1) < name(parameter2);
+    });
+
+    std::string normalized;
+    if (!scheme.empty())
+        normalized.append(scheme).append("://");
+    normalized.append(host);
+    if (path.empty() && !host.empty())
+        normalized.push_back('/');
+    normalized.append(path);
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        normalized.push_back(i == 0 ? '?' : '&');
+        normalized.append(parameters[i]);
+    }
+    return normalized;
+}
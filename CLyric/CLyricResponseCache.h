@@ -0,0 +1,97 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICRESPONSECACHE_H
+#define CRYSTALLYRICS_CLYRICRESPONSECACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cLyric {
+
+    // On-disk cache of provider responses, keyed by the normalized request URL plus the POST body.
+    // Every response is one zlib compressed file in the cache directory. Entries expire after the time to live
+    // of their kind, and the least recently used ones are evicted once the files exceed the size budget.
+    // The cache stays disabled until it is opened.
+    class CLyricResponseCache {
+    public:
+        enum class Kind {
+            Search,  // Search results, which change as the providers add songs
+            Content  // Lyric bodies and song metadata, which hardly ever change
+        };
+
+        struct FileHeader {
+            uint32_t magic, version;
+            int64_t expiryTime;      // in seconds since the epoch
+            uint32_t keySize, bodySize;
+        };
+
+        static constexpr uint32_t magic = 0x50534552; // "RESP"
+        static constexpr uint32_t version = 1;
+
+    private:
+        struct Entry {
+            uint64_t size;                           // of the file
+            std::filesystem::file_time_type lastUse; // The write time of the file, updated on every load
+        };
+
+        mutable std::mutex mutex; // Guards the members, file I/O and compression run without it
+        std::string directoryPath;
+        std::map<std::string, Entry> entries; // by file name
+        uint64_t sizeBudget = 0, totalSize = 0;
+        std::chrono::seconds searchTimeToLive = std::chrono::hours(6);
+        std::chrono::seconds contentTimeToLive = std::chrono::hours(24 * 30);
+
+        [[nodiscard]] std::string filePath(const std::string &fileName) const;
+
+        // The bookkeeping only, the paths of the files to delete once the lock is released are added to removed
+        void remove(const std::string &fileName, std::vector<std::string> &removed);
+
+        // Removes the least recently used entries until the files fit into the budget, like remove
+        void evict(std::vector<std::string> &removed);
+
+    public:
+        CLyricResponseCache() = default;
+
+        CLyricResponseCache(const CLyricResponseCache &) = delete;
+
+        CLyricResponseCache &operator=(const CLyricResponseCache &) = delete;
+
+        // The cache of all providers
+        static CLyricResponseCache &instance();
+
+        // Uses the directory, created if missing, for at most sizeBudget bytes of files
+        bool open(const std::string &directoryPath, uint64_t sizeBudget = 32 * 1024 * 1024);
+
+        void close();
+
+        [[nodiscard]] bool isOpen() const;
+
+        void setTimeToLive(Kind kind, std::chrono::seconds timeToLive);
+
+        // The stored response of the request, false if there is none or it has expired
+        bool load(std::string_view url, std::string_view postBody, std::string &body);
+
+        void store(std::string_view url, std::string_view postBody, Kind kind, const std::string &body);
+
+        // Removes every entry
+        void clear();
+
+        // Bytes of the cache files
+        [[nodiscard]] uint64_t size() const;
+
+        // Lowercases the scheme and the host, drops default ports and the fragment, sorts query parameters by name
+        static std::string normalizeUrl(std::string_view url);
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICRESPONSECACHE_H
@@ -4,17 +4,33 @@
 
 #include "CLyricSearch.h"
 
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <numeric>
+#include <thread>
 
 #include "CLyricUtils.h"
+#include "CLyricBinary.h"
+#include "CLyricRanker.h"
+#include "CLyricNegativeCache.h"
+#include "CLyricProviderHealth.h"
 
 using namespace cLyric;
 
 CLyric CLyricSearch::fetchCLyric(const std::string &title, const std::string &album, const std::string &artist,
                                  int duration, const std::string &saveDirectoryPath) {
     auto name = saveDirectoryPath + "/" + CLyric::filename(title, album, artist);
-    std::ifstream localFile(std::filesystem::u8path(saveDirectoryPath + "/" + CLyric::filename(title, album, artist)));
+    CLyric cachedLyric;
+    if (loadBinaryCache(name, cachedLyric) && cachedLyric.isValid()) {
+        cachedLyric.track.source = "LocalFile";
+        return cachedLyric;
+    }
+
+    std::ifstream localFile(std::filesystem::u8path(name));
     std::string lineContent, localFileContents;
     if (localFile.is_open()) {
         while (std::getline(localFile, lineContent)) {
@@ -24,6 +40,8 @@ CLyric CLyricSearch::fetchCLyric(const std::string &title, const std::string &al
         localFile.close();
         CLyric lyric(localFileContents, LyricStyle::CLrcStyle);
         if (lyric.isValid()) {
+            // Compile the cache so the next load skips parsing
+            saveBinaryCache(lyric, name);
             lyric.track.source = "LocalFile";
             return lyric;
         }
@@ -37,48 +55,53 @@ CLyric CLyricSearch::fetchCLyric(const std::string &title, const std::string &al
         return instrumentalLyric;
     }
 
-    std::function<void(std::vector<CLyric>)> callback = [this](std::vector<CLyric> lyrics) {
-        this->appendResultCallback(std::move(lyrics));
-    };
-    for (std::unique_ptr<CLyricProvider> &provider: providerList) {
-        provider->searchLyrics(Track(title, album, artist, "", "", duration), callback);
+    // Tracks which found nothing recently are not searched again until their re-check interval passed
+    Track track(title, album, artist, "", "", duration);
+    CLyricNegativeCache negativeCache(saveDirectoryPath);
+    if (cancellation.shouldStop() || negativeCache.shouldSkip(track))
+        return CLyric();
+    size_t answers = stats.answers;
+    std::vector<CLyricCandidate> candidates = searchCandidates(track);
+    bool answered = stats.answers > answers;
+
+    // Checked before any lyric request, a version of another length seldom has matching timestamps
+    if (durationTolerance >= 0) {
+        CLyricRanker ranker(title, artist, duration);
+        auto mismatch = [&ranker, this](const CLyricCandidate &candidate) {
+            return !ranker.durationMatches(candidate.track, durationTolerance);
+        };
+        auto end = std::remove_if(candidates.begin(), candidates.end(), mismatch);
+        stats.durationMismatches += static_cast<size_t>(candidates.end() - end);
+        candidates.erase(end, candidates.end());
+    }
+
+    // Download the best candidates only, the next ones if none of them is usable
+    auto isValid = [](const CLyric &lyric) { return lyric.isValid(); };
+    for (size_t begin = 0; begin < candidates.size() && !cancellation.shouldStop(); begin += downloadCount) {
+        auto end = candidates.begin() + std::min(candidates.size(), begin + downloadCount);
+        downloadCandidates(track, std::vector<CLyricCandidate>(candidates.begin() + begin, end));
+        if (std::any_of(results.begin(), results.end(), isValid))
+            break;
+    }
+
+    CLyricRanker(title, artist, duration).rank(results);
+
+    // A stopped search may have missed lyrics, and one no provider answered (offline, server errors or every
+    // circuit open) tells nothing. Only a complete search which got an answer tells the track has none.
+    bool found = !results.empty() && results.front().isValid();
+    if (found) {
+        negativeCache.remove(track);
+        CLyricProviderHealth::instance().recordChosen(results.front().track.source);
+    } else if (!cancellation.shouldStop() && answered) {
+        negativeCache.recordMiss(track);
     }
 
-    std::stable_sort(results.begin(), results.end(),
-                     [title, artist](const CLyric &res1, const CLyric &res2) {
-                         int length = title.size() + artist.size() / 2;
-                         int distance1 =
-                                 stringDistance(res1.track.title, title) +
-                                 stringDistance(res1.track.artist, artist) / 2;
-                         int distance2 =
-                                 stringDistance(res2.track.title, title) +
-                                 stringDistance(res2.track.artist, artist) / 2;
-                         double score1 = 1 - double(distance1) / length;
-                         double score2 = 1 - double(distance2) / length;
-                         if (std::any_of(res1.lyrics.begin(), res1.lyrics.end(),
-                                         [](CLyricItem item) { return !item.translation.empty(); }))
-                             score1 += 0.2;
-                         if (std::any_of(res2.lyrics.begin(), res2.lyrics.end(),
-                                         [](CLyricItem item) { return !item.translation.empty(); }))
-                             score2 += 0.2;
-                         if (std::any_of(res1.lyrics.begin(), res1.lyrics.end(),
-                                         [](CLyricItem item) { return !item.timecodes.empty(); }))
-                             score1 += 0.1;
-                         if (std::any_of(res2.lyrics.begin(), res2.lyrics.end(),
-                                         [](CLyricItem item) { return !item.timecodes.empty(); }))
-                             score2 += 0.1;
-                         if (!res1.isValid())
-                             score1 -= 1;
-                         if (!res2.isValid())
-                             score2 -= 1;
-                         return score1 > score2;
-                     });
+    CLyricProviderHealth::instance().save();
 
     if (results.empty())
         return CLyric();
-    CLyric resultLyric = results.front();
 
-    return resultLyric;
+    return std::move(results.front());
 }
 
 void CLyricSearch::appendResultCallback(std::vector<CLyric> lyrics) {
@@ -90,21 +113,143 @@ void CLyricSearch::appendResultCallback(std::vector<CLyric> lyrics) {
     }
 }
 
-std::vector<CLyric> CLyricSearch::searchCLyric(const std::string &title, const std::string &artist, int duration) {
-    std::function<void(std::vector<CLyric>)> callback = [this](std::vector<CLyric> lyrics) {
-        this->appendResultCallback(std::move(lyrics));
-    };
-    for (std::unique_ptr<CLyricProvider> &provider: providerList) {
-        provider->searchLyrics(Track(title, "", artist, "", "", duration), callback);
+void CLyricSearch::runProviders(const std::function<void(size_t, CLyricProvider &)> &task) {
+    // Every provider owns its curl handle, so they run side by side and a phase takes as long as the
+    // slowest one. A stopped search aborts the transfers in flight, so the joins return soon.
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::size(providerList); ++i) {
+        threads.emplace_back([this, &task, i] {
+            try {
+                task(i, *providerList[i]);
+            } catch (const std::exception &) {
+                // A malformed response only loses the work of its provider
+            }
+        });
     }
+    for (std::thread &thread: threads)
+        thread.join();
+}
+
+std::vector<CLyricCandidate> CLyricSearch::searchCandidates(const Track &track) {
+    CLyricProviderHealth &health = CLyricProviderHealth::instance();
+
+    // Providers which answer reliably and whose lyrics get chosen come first
+    std::iota(providerOrder.begin(), providerOrder.end(), 0);
+    std::vector<double> healthScores;
+    for (const auto &provider: providerList)
+        healthScores.push_back(health.score(provider->name()));
+    std::stable_sort(providerOrder.begin(), providerOrder.end(), [&healthScores](size_t index1, size_t index2) {
+        return healthScores[index1] > healthScores[index2];
+    });
+
+    std::vector<std::vector<CLyricCandidate>> providerCandidates(std::size(providerList));
+    std::atomic<size_t> answers = 0;
+    runProviders([this, &track, &providerCandidates, &health, &answers](size_t index, CLyricProvider &provider) {
+        // Skipped while the circuit of the provider is open
+        if (!health.allowRequest(provider.name()))
+            return;
+        provider.setTimeout(health.timeout(provider.name()));
+
+        size_t transfers = provider.transferCount();
+        auto startTime = std::chrono::steady_clock::now();
+        bool success = false;
+        std::vector<CLyricCandidate> candidates;
+        try {
+            candidates = provider.searchCandidates(track);
+            success = !provider.lastRequestFailed();
+        } catch (const std::exception &) {
+            candidates.clear();
+        }
+        auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - startTime);
+        // Only requests sent over the network are measured: THBWiki sends none to search, and responses from
+        // the response cache take no time. A search cancelled for a track change says nothing about the
+        // provider either, one out of time does.
+        bool sent = provider.transferCount() > transfers;
+        if (cancellation.isCancelled() || !sent) {
+            health.recordCancelled(provider.name());
+        } else {
+            health.recordResult(provider.name(), success, latency);
+        }
+        if (success && (sent || provider.lastResponseCached()))
+            ++answers;
+
+        for (CLyricCandidate &candidate: candidates)
+            candidate.provider = index;
+        providerCandidates[index] = std::move(candidates);
+    });
+
+    stats.answers += answers;
+
+    std::vector<CLyricCandidate> candidates;
+    for (size_t index: providerOrder) {
+        candidates.insert(candidates.end(), std::make_move_iterator(providerCandidates[index].begin()),
+                          std::make_move_iterator(providerCandidates[index].end()));
+    }
+    stats.candidates += candidates.size();
+
+    // Scored once up front, candidates of equal score stay in provider order
+    CLyricRanker ranker(track.title, track.artist, track.duration);
+    std::vector<CLyricScore> scores;
+    scores.reserve(candidates.size());
+    for (const CLyricCandidate &candidate: candidates)
+        scores.push_back(ranker.score(candidate.track));
+    std::vector<size_t> order(candidates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&scores](size_t index1, size_t index2) {
+        return CLyricRanker::better(scores[index1], scores[index2]);
+    });
+
+    std::vector<CLyricCandidate> ranked;
+    ranked.reserve(candidates.size());
+    for (size_t index: order)
+        ranked.push_back(std::move(candidates[index]));
+    return ranked;
+}
+
+void CLyricSearch::downloadCandidates(const Track &track, const std::vector<CLyricCandidate> &candidates) {
+    // Results are kept per provider and appended in provider order to stay deterministic
+    std::vector<std::vector<CLyric>> providerResults(std::size(providerList));
+    std::vector<size_t> transfers(std::size(providerList));
+    std::vector<uint64_t> bytes(std::size(providerList));
+    for (size_t i = 0; i < std::size(providerList); ++i) {
+        transfers[i] = providerList[i]->transferCount();
+        bytes[i] = providerList[i]->transferBytes();
+    }
+    runProviders([&track, &candidates, &providerResults](size_t index, CLyricProvider &provider) {
+        std::vector<CLyricCandidate> own;
+        for (const CLyricCandidate &candidate: candidates) {
+            if (candidate.provider == index)
+                own.push_back(candidate);
+        }
+        if (!own.empty())
+            providerResults[index] = provider.downloadLyrics(track, own);
+    });
+
+    for (size_t i = 0; i < std::size(providerList); ++i) {
+        stats.lyricRequests += providerList[i]->transferCount() - transfers[i];
+        stats.lyricBytes += providerList[i]->transferBytes() - bytes[i];
+    }
+
+    for (size_t index: providerOrder)
+        appendResultCallback(std::move(providerResults[index]));
+}
+
+std::vector<CLyric> CLyricSearch::searchCLyric(const std::string &title, const std::string &artist, int duration) {
+    Track track(title, "", artist, "", "", duration);
+    downloadCandidates(track, searchCandidates(track));
+    CLyricProviderHealth::instance().save();
     return this->results;
 }
 
-CLyricSearch::CLyricSearch() {
+CLyricSearch::CLyricSearch(CLyricCancellation cancellation) : cancellation(std::move(cancellation)) {
     providerList[0] = std::make_unique<Xiami>();
     providerList[1] = std::make_unique<Netease>();
     providerList[2] = std::make_unique<QQMusic>();
     providerList[3] = std::make_unique<Kugou>();
     providerList[4] = std::make_unique<Gecimi>();
     providerList[5] = std::make_unique<THBWiki>();
+    for (auto &provider: providerList)
+        provider->setCancellation(this->cancellation);
+    std::iota(providerOrder.begin(), providerOrder.end(), 0);
 }
@@ -6,10 +6,33 @@
 #define CRYSTALLYRICS_CLYRICSEARCH_H
 
 #include "CLyric.h"
+#include "CLyricCancellation.h"
 #include "CLyricProvider.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <vector>
+
 namespace cLyric {
 
+    struct CLyricSearchStats {
+        size_t answers = 0;            // Providers whose search request got a search result, cached ones included
+        size_t candidates = 0;         // Search hits of all providers
+        size_t durationMismatches = 0; // Candidates dropped before download for their duration
+        size_t lyricRequests = 0;      // Requests of the content phase
+        uint64_t lyricBytes = 0;       // Bytes received by them
+
+        // Every dropped candidate saves at least its lyric request
+        [[nodiscard]] size_t savedRequests() const { return durationMismatches; }
+
+        // Estimated from the average size of the lyric responses of the same search
+        [[nodiscard]] uint64_t savedBytes() const {
+            return lyricRequests > 0 ? lyricBytes / lyricRequests * durationMismatches : 0;
+        }
+    };
+
     class CLyricSearch {
         std::vector<CLyric> results;
 
@@ -17,12 +40,42 @@ namespace cLyric {
 
         std::unique_ptr<CLyricProvider> providerList[6];
 
+        // Indexes of providerList by CLyricProviderHealth::score, best first
+        std::vector<size_t> providerOrder = std::vector<size_t>(std::size(providerList));
+
+        CLyricCancellation cancellation;
+
+        size_t downloadCount = 3;
+        int durationTolerance = 15;
+        CLyricSearchStats stats;
+
+        // Runs task for every provider on its own thread, an exception only loses the work of its provider
+        void runProviders(const std::function<void(size_t index, CLyricProvider &provider)> &task);
+
+        // Metadata phase: the search hits of all providers, ranked against each other by distance and duration
+        std::vector<CLyricCandidate> searchCandidates(const Track &track);
+
+        // Content phase: downloads candidates on their providers and appends the lyrics in provider order
+        void downloadCandidates(const Track &track, const std::vector<CLyricCandidate> &candidates);
+
     public:
-        explicit CLyricSearch();
+        // The search stops when cancellation is cancelled or past its deadline, and returns the lyrics found so far
+        explicit CLyricSearch(CLyricCancellation cancellation = CLyricCancellation());
+
+        // Lyrics fetchCLyric downloads at a time, the best ranked candidates across all providers. Another
+        // round of downloads only starts if none of them yields a valid lyric.
+        void setDownloadCount(size_t count) { downloadCount = std::max<size_t>(1, count); }
+
+        // Candidates whose duration differs from the track by more than seconds are not downloaded by
+        // fetchCLyric, negative to download them regardless. Live and remixed versions are usually far off.
+        void setDurationTolerance(int seconds) { durationTolerance = seconds; }
+
+        [[nodiscard]] const CLyricSearchStats &statistics() const { return stats; }
 
         CLyric fetchCLyric(const std::string &title, const std::string &album, const std::string &artist, int duration,
                            const std::string &saveDirectoryPath);
 
+        // Downloads every candidate, for the user to choose from
         std::vector<CLyric> searchCLyric(const std::string &title, const std::string &artist, int duration);
     };
 
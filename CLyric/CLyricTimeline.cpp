@@ -0,0 +1,33 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "CLyricTimeline.h"
+
+#include <algorithm>
+
+using namespace cLyric;
+
+CLyricTimeline::CLyricTimeline(const CLyric &lyric) : offset(lyric.offset) {
+    startTimes.reserve(lyric.lyrics.size());
+    for (const CLyricItem &item: lyric.lyrics)
+        startTimes.push_back(item.startTime);
+}
+
+CLyricTimeline::Position CLyricTimeline::seek(int position) const {
+    Position result;
+    if (startTimes.empty())
+        return result;
+
+    // Offset is applied to the position instead of every start time
+    int time = position - offset;
+    auto next = std::upper_bound(startTimes.begin(), startTimes.end(), time);
+    size_t line = next == startTimes.begin() ? 0 : static_cast<size_t>(next - startTimes.begin()) - 1;
+
+    result.line = static_cast<int>(line);
+    result.timeInLine = time - startTimes[line];
+    if (line + 1 < startTimes.size())
+        result.nextEventIn = startTimes[line + 1] - time;
+    return result;
+}
@@ -0,0 +1,46 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#ifndef CRYSTALLYRICS_CLYRICTIMELINE_H
+#define CRYSTALLYRICS_CLYRICTIMELINE_H
+
+#include "CLyric.h"
+
+#include <vector>
+
+namespace cLyric {
+
+    // Seek index over the start times of a lyric, built once per lyric.
+    // Lines are expected in start time order, as CLyric parses them.
+    class CLyricTimeline {
+        std::vector<int> startTimes;
+        int offset = 0; // in milliseconds, added to every start time
+
+    public:
+        struct Position {
+            int line = 0;         // Current line, the first line before it starts
+            int timeInLine = 0;   // in milliseconds, negative before the first line
+            int nextEventIn = -1; // Time until the next line starts, -1 on the last line
+        };
+
+        CLyricTimeline() = default;
+
+        explicit CLyricTimeline(const CLyric &lyric);
+
+        void setOffset(int newOffset) { offset = newOffset; }
+
+        [[nodiscard]] size_t size() const { return startTimes.size(); }
+
+        [[nodiscard]] bool empty() const { return startTimes.empty(); }
+
+        // Start time of the line with the offset applied
+        [[nodiscard]] int startTime(size_t line) const { return startTimes[line] + offset; }
+
+        [[nodiscard]] Position seek(int position) const;
+    };
+
+}
+
+#endif //CRYSTALLYRICS_CLYRICTIMELINE_H
@@ -7,33 +7,495 @@
 #include <algorithm>
 #include <zlib.h>
 #include <cstring>
+#include <cstdint>
+#include <bitset>
+#include <iterator>
 
-size_t utf8StringChars(const std::string &str) {
-    size_t count = 0, i = 0;
-    while (i < str.length()) {
-        auto ch = static_cast<unsigned char>(str[i++]);
+#if defined(__x86_64__) || defined(_M_X64)
+#define CLYRIC_UTF8_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CLYRIC_TARGET(features)
+#else
+#define CLYRIC_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace {
+
+    inline bool isContinuationByte(unsigned char ch) {
+        return (ch & 0xC0u) == 0x80u;
+    }
+
+#ifdef CLYRIC_UTF8_X86
+
+    struct CpuFeatures {
+        bool ssse3 = false, avx2 = false;
+
+        CpuFeatures() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            int maxLeaf = info[0];
+            __cpuid(info, 1);
+            ssse3 = info[2] & (1 << 9);
+            bool osxsave = info[2] & (1 << 27);
+            if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(info, 7, 0);
+                avx2 = info[1] & (1 << 5);
+            }
+#else
+            __builtin_cpu_init();
+            ssse3 = __builtin_cpu_supports("ssse3");
+            avx2 = __builtin_cpu_supports("avx2");
+#endif
+        }
+    };
+
+    const CpuFeatures &cpuFeatures() {
+        static const CpuFeatures features;
+        return features;
+    }
+
+    // SSE2 is part of x86-64, counts the bytes which are not continuation bytes
+    size_t utf8StringCharsSSE2(const char *data, size_t length) {
+        const __m128i continuationLimit = _mm_set1_epi8(-64); // 0xC0, continuation bytes are below it when signed
+        size_t continuationBytes = 0, i = 0;
+        while (i + 16 <= length) {
+            // Byte counters would overflow after 255 blocks
+            __m128i counters = _mm_setzero_si128();
+            size_t blockEnd = std::min(length & ~size_t(15), i + 255 * 16);
+            for (; i < blockEnd; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                counters = _mm_sub_epi8(counters, _mm_cmplt_epi8(block, continuationLimit));
+            }
+            __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+            continuationBytes += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+        }
+        for (; i < length; ++i)
+            continuationBytes += isContinuationByte(data[i]);
+        return length - continuationBytes;
+    }
+
+    CLYRIC_TARGET("avx2")
+    size_t utf8StringCharsAVX2(const char *data, size_t length) {
+        const __m256i continuationLimit = _mm256_set1_epi8(-64);
+        size_t continuationBytes = 0, i = 0;
+        while (i + 32 <= length) {
+            __m256i counters = _mm256_setzero_si256();
+            size_t blockEnd = std::min(length & ~size_t(31), i + 255 * 32);
+            for (; i < blockEnd; i += 32) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                counters = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(continuationLimit, block));
+            }
+            __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+            continuationBytes += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                     _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        }
+        for (; i < length; ++i)
+            continuationBytes += isContinuationByte(data[i]);
+        return length - continuationBytes;
+    }
+
+    // Lookup based validation from "Validating UTF-8 In Less Than One Instruction Per Byte"
+    // (Keiser & Lemire), each error class is a bit which survives the AND of three nibble lookups.
+    constexpr uint8_t TOO_SHORT = 1 << 0, TOO_LONG = 1 << 1, OVERLONG_3 = 1 << 2, TOO_LARGE = 1 << 3,
+            SURROGATE = 1 << 4, OVERLONG_2 = 1 << 5, TOO_LARGE_1000 = 1 << 6, OVERLONG_4 = 1 << 6,
+            TWO_CONTS = 1 << 7, CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    CLYRIC_TARGET("ssse3")
+    inline __m128i utf8BlockErrors(__m128i input, __m128i previousInput) {
+        const __m128i lowNibble = _mm_set1_epi8(0x0F);
+        const __m128i byte1HighTable = _mm_setr_epi8(
+                TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+                TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+        const __m128i byte1LowTable = _mm_setr_epi8(
+                CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+                CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000);
+        const __m128i byte2HighTable = _mm_setr_epi8(
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+        __m128i previous1 = _mm_alignr_epi8(input, previousInput, 15);
+        __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, _mm_and_si128(_mm_srli_epi16(previous1, 4), lowNibble));
+        __m128i byte1Low = _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(previous1, lowNibble));
+        __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+        __m128i specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+        // The third and fourth bytes of 3 and 4 byte sequences must be continuations
+        __m128i previous2 = _mm_alignr_epi8(input, previousInput, 14);
+        __m128i previous3 = _mm_alignr_epi8(input, previousInput, 13);
+        __m128i isThirdByte = _mm_subs_epu8(previous2, _mm_set1_epi8(char(0xE0 - 0x80)));
+        __m128i isFourthByte = _mm_subs_epu8(previous3, _mm_set1_epi8(char(0xF0 - 0x80)));
+        __m128i must23 = _mm_and_si128(_mm_or_si128(isThirdByte, isFourthByte), _mm_set1_epi8(char(0x80)));
+        return _mm_xor_si128(must23, specialCases);
+    }
+
+    CLYRIC_TARGET("ssse3")
+    bool utf8ValidateSSSE3(const char *data, size_t length) {
+        // Bytes which start a sequence that does not fit in the rest of the block
+        const __m128i incompleteLimit = _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1));
+
+        __m128i errors = _mm_setzero_si128(), previousInput = _mm_setzero_si128();
+        __m128i previousIncomplete = _mm_setzero_si128();
+        auto processBlock = [&](__m128i input) {
+            if (_mm_movemask_epi8(input) == 0) {
+                errors = _mm_or_si128(errors, previousIncomplete);
+                previousIncomplete = _mm_setzero_si128();
+            } else {
+                errors = _mm_or_si128(errors, utf8BlockErrors(input, previousInput));
+                previousIncomplete = _mm_subs_epu8(input, incompleteLimit);
+            }
+            previousInput = input;
+        };
+
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+            processBlock(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        if (i < length) {
+            // Zero padding is ASCII, which reports sequences cut by the end of the string
+            alignas(16) char tail[16] = {};
+            std::memcpy(tail, data + i, length - i);
+            processBlock(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)));
+        }
+        errors = _mm_or_si128(errors, previousIncomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    size_t utf8CharsToBytesSSE2(const char *data, size_t length, size_t chars) {
+        const __m128i continuationLimit = _mm_set1_epi8(-64);
+        size_t i = 0;
+        // Skips whole blocks whose chars all come before the wanted one
+        for (; i + 16 <= length; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            auto leadMask = static_cast<unsigned>(~_mm_movemask_epi8(_mm_cmplt_epi8(block, continuationLimit))) &
+                            0xFFFFu;
+            size_t leadCount = 0;
+            for (unsigned mask = leadMask; mask; mask &= mask - 1)
+                ++leadCount;
+            if (leadCount > chars)
+                break;
+            chars -= leadCount;
+        }
+        for (; i < length; ++i) {
+            if (!isContinuationByte(data[i]) && chars-- == 0)
+                return i;
+        }
+        return length;
+    }
+
+#endif
+
+}
+
+size_t utf8StringCharsScalar(std::string_view str) {
+    size_t count = 0;
+    for (char ch: str)
+        count += !isContinuationByte(ch);
+    return count;
+}
+
+size_t utf8StringChars(std::string_view str) {
+#ifdef CLYRIC_UTF8_X86
+    if (cpuFeatures().avx2)
+        return utf8StringCharsAVX2(str.data(), str.size());
+    return utf8StringCharsSSE2(str.data(), str.size());
+#else
+    return utf8StringCharsScalar(str);
+#endif
+}
+
+bool utf8ValidateScalar(std::string_view str) {
+    size_t i = 0;
+    while (i < str.size()) {
+        auto ch = static_cast<unsigned char>(str[i]);
         if (ch < 0x80u) {
-            // ASCII (UTF-8 single byte)
-            ++count;
-            continue;
-        } else if (ch < 0xE0u) {
-            // UTF-8 double byte
-            ++count;
-            i += 1;
-            continue;
-        } else if (ch < 0xF0u) {
-            // UTF-8 triple byte
-            ++count;
-            i += 2;
+            ++i;
             continue;
+        }
+
+        size_t length;
+        unsigned char secondMin = 0x80u, secondMax = 0xBFu;
+        if (ch >= 0xC2u && ch <= 0xDFu) {
+            length = 2;
+        } else if (ch >= 0xE0u && ch <= 0xEFu) {
+            length = 3;
+            if (ch == 0xE0u) secondMin = 0xA0u;      // Overlong
+            else if (ch == 0xEDu) secondMax = 0x9Fu; // Surrogates
+        } else if (ch >= 0xF0u && ch <= 0xF4u) {
+            length = 4;
+            if (ch == 0xF0u) secondMin = 0x90u;      // Overlong
+            else if (ch == 0xF4u) secondMax = 0x8Fu; // Above U+10FFFF
         } else {
-            // UTF-8 quadruple byte
-            ++count;
-            i += 3;
-            continue;
+            return false;
+        }
+
+        if (str.size() - i < length)
+            return false;
+        auto second = static_cast<unsigned char>(str[i + 1]);
+        if (second < secondMin || second > secondMax)
+            return false;
+        for (size_t j = 2; j < length; ++j) {
+            if (!isContinuationByte(str[i + j]))
+                return false;
         }
+        i += length;
     }
-    return count;
+    return true;
+}
+
+bool utf8Validate(std::string_view str) {
+#ifdef CLYRIC_UTF8_X86
+    if (cpuFeatures().ssse3)
+        return utf8ValidateSSSE3(str.data(), str.size());
+#endif
+    return utf8ValidateScalar(str);
+}
+
+size_t utf8CharsToBytes(std::string_view str, size_t chars) {
+#ifdef CLYRIC_UTF8_X86
+    return utf8CharsToBytesSSE2(str.data(), str.size(), chars);
+#else
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (!isContinuationByte(str[i]) && chars-- == 0)
+            return i;
+    }
+    return str.size();
+#endif
+}
+
+char32_t utf8NextChar(std::string_view str, size_t &pos) {
+    auto ch = static_cast<unsigned char>(str[pos++]);
+    if (ch < 0x80u)
+        return ch;
+
+    size_t length;
+    char32_t codepoint, minimum;
+    if (ch >= 0xC0u && ch < 0xE0u) {
+        length = 1, codepoint = ch & 0x1Fu, minimum = 0x80;
+    } else if (ch >= 0xE0u && ch < 0xF0u) {
+        length = 2, codepoint = ch & 0x0Fu, minimum = 0x800;
+    } else if (ch >= 0xF0u && ch < 0xF8u) {
+        length = 3, codepoint = ch & 0x07u, minimum = 0x10000;
+    } else {
+        return utf8ReplacementChar;
+    }
+
+    size_t end = pos + length;
+    if (end > str.size())
+        return utf8ReplacementChar;
+    for (size_t i = pos; i < end; ++i) {
+        if (!isContinuationByte(str[i]))
+            return utf8ReplacementChar;
+        codepoint = (codepoint << 6) | (static_cast<unsigned char>(str[i]) & 0x3Fu);
+    }
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        return utf8ReplacementChar;
+    pos = end;
+    return codepoint;
+}
+
+namespace {
+
+    inline int popcount64(uint64_t value) {
+        return static_cast<int>(std::bitset<64>(value).count());
+    }
+
+    // Patterns up to stackWords * 64 bytes need no heap allocation
+    constexpr size_t stackWords = 4;
+
+    // Match masks of a pattern, bit i of word w for byte c is set if pattern[w * 64 + i] == c.
+    // Short patterns are kept on the stack, only the rows of bytes which occur in the strings are cleared.
+    class PatternMasks {
+        uint64_t stackMasks[256 * stackWords];
+        std::vector<uint64_t> heapMasks;
+        uint64_t *masks;
+
+    public:
+        using CharType = char;
+
+        const size_t words;
+
+        PatternMasks(std::string_view pattern, std::string_view text) : words((pattern.size() + 63) / 64) {
+            if (words <= stackWords) {
+                masks = stackMasks;
+                for (char ch: text)
+                    std::fill_n(row(ch), words, 0);
+                for (char ch: pattern)
+                    std::fill_n(row(ch), words, 0);
+            } else {
+                heapMasks.assign(256 * words, 0);
+                masks = heapMasks.data();
+            }
+            for (size_t i = 0; i < pattern.size(); ++i)
+                row(pattern[i])[i / 64] |= uint64_t(1) << (i % 64);
+        }
+
+        PatternMasks(const PatternMasks &) = delete;
+
+        PatternMasks &operator=(const PatternMasks &) = delete;
+
+        uint64_t *row(char ch) { return masks + static_cast<unsigned char>(ch) * words; }
+    };
+
+    // Array of size elements, on the stack up to StackSize elements
+    template<typename T, size_t StackSize>
+    class StackBuffer {
+        T stackData[StackSize];
+        std::vector<T> heapData;
+        T *data;
+
+    public:
+        StackBuffer(size_t size, T value) {
+            if (size <= StackSize) {
+                data = stackData;
+                std::fill_n(data, size, value);
+            } else {
+                heapData.assign(size, value);
+                data = heapData.data();
+            }
+        }
+
+        StackBuffer(const StackBuffer &) = delete;
+
+        StackBuffer &operator=(const StackBuffer &) = delete;
+
+        T &operator[](size_t index) { return data[index]; }
+
+        T *get() { return data; }
+    };
+
+    using WordVector = StackBuffer<uint64_t, stackWords>;
+
+    // Match masks of a code point pattern. Rows are kept for the distinct chars of the pattern only, sorted for
+    // a binary search, every other char gets the zero row after them.
+    class CodepointMasks {
+        StackBuffer<char32_t, 128> alphabet;
+        size_t alphabetSize;
+        StackBuffer<uint64_t, 256> masks;
+
+    public:
+        using CharType = char32_t;
+
+        const size_t words;
+
+        CodepointMasks(std::u32string_view pattern, std::u32string_view)
+                : alphabet(pattern.size(), 0), alphabetSize(0),
+                  masks((pattern.size() + 1) * ((pattern.size() + 63) / 64), 0), words((pattern.size() + 63) / 64) {
+            std::copy(pattern.begin(), pattern.end(), alphabet.get());
+            std::sort(alphabet.get(), alphabet.get() + pattern.size());
+            alphabetSize = static_cast<size_t>(std::unique(alphabet.get(), alphabet.get() + pattern.size()) -
+                                               alphabet.get());
+            for (size_t i = 0; i < pattern.size(); ++i)
+                row(pattern[i])[i / 64] |= uint64_t(1) << (i % 64);
+        }
+
+        CodepointMasks(const CodepointMasks &) = delete;
+
+        CodepointMasks &operator=(const CodepointMasks &) = delete;
+
+        uint64_t *row(char32_t ch) {
+            char32_t *begin = alphabet.get(), *end = begin + alphabetSize;
+            char32_t *entry = std::lower_bound(begin, end, ch);
+            size_t index = entry != end && *entry == ch ? static_cast<size_t>(entry - begin) : alphabetSize;
+            return masks.get() + index * words;
+        }
+    };
+
+    // Hyyrö's block based variant of Myers' algorithm, columns of the DP matrix are encoded as
+    // +1/-1 vertical deltas and advanced 64 rows at a time, carrying the horizontal delta between words.
+    // Masks decides the char type, bytes by PatternMasks or code points by CodepointMasks.
+    template<typename Masks>
+    int levenshteinBitParallel(std::basic_string_view<typename Masks::CharType> pattern,
+                               std::basic_string_view<typename Masks::CharType> text) {
+        if (pattern.empty())
+            return static_cast<int>(text.size());
+
+        Masks masks(pattern, text);
+        size_t words = masks.words;
+        WordVector positive(words, ~uint64_t(0)), negative(words, 0);
+
+        uint64_t lastBit = uint64_t(1) << ((pattern.size() - 1) % 64);
+        int distance = static_cast<int>(pattern.size());
+        for (auto ch: text) {
+            const uint64_t *match = masks.row(ch);
+            // The first row of the matrix grows by one per char
+            uint64_t positiveCarry = 1, negativeCarry = 0;
+            for (size_t w = 0; w < words; ++w) {
+                uint64_t x = match[w] | negativeCarry;
+                uint64_t diagonal = (((x & positive[w]) + positive[w]) ^ positive[w]) | x | negative[w];
+                uint64_t horizontalPositive = negative[w] | ~(diagonal | positive[w]);
+                uint64_t horizontalNegative = diagonal & positive[w];
+
+                uint64_t positiveIn = positiveCarry, negativeIn = negativeCarry;
+                if (w + 1 < words) {
+                    positiveCarry = horizontalPositive >> 63;
+                    negativeCarry = horizontalNegative >> 63;
+                } else {
+                    distance += (horizontalPositive & lastBit) != 0;
+                    distance -= (horizontalNegative & lastBit) != 0;
+                }
+                horizontalPositive = (horizontalPositive << 1) | positiveIn;
+                horizontalNegative = (horizontalNegative << 1) | negativeIn;
+
+                positive[w] = horizontalNegative | ~(diagonal | horizontalPositive);
+                negative[w] = horizontalPositive & diagonal;
+            }
+        }
+        return distance;
+    }
+
+    // Allison-Dix / Hyyrö bit-vector LCS, a zero bit in row marks a row where the LCS grows,
+    // the additions are chained across words with their carries
+    template<typename Masks>
+    int lcsBitParallel(std::basic_string_view<typename Masks::CharType> pattern,
+                       std::basic_string_view<typename Masks::CharType> text) {
+        if (pattern.empty() || text.empty())
+            return 0;
+
+        Masks masks(pattern, text);
+        size_t words = masks.words;
+        WordVector row(words, ~uint64_t(0));
+
+        for (auto ch: text) {
+            const uint64_t *match = masks.row(ch);
+            uint64_t carry = 0;
+            for (size_t w = 0; w < words; ++w) {
+                uint64_t matched = row[w] & match[w];
+                uint64_t sum = row[w] + matched;
+                uint64_t carryOut = sum < row[w];
+                sum += carry;
+                carryOut |= sum < carry;
+                row[w] = sum | (row[w] - matched);
+                carry = carryOut;
+            }
+        }
+
+        int length = 0;
+        for (size_t w = 0; w + 1 < words; ++w)
+            length += popcount64(~row[w]);
+        size_t lastBits = pattern.size() - (words - 1) * 64;
+        uint64_t lastMask = lastBits == 64 ? ~uint64_t(0) : (uint64_t(1) << lastBits) - 1;
+        return length + popcount64(~row[words - 1] & lastMask);
+    }
+
 }
 
 int stringDistance(const std::string &compareString, const std::string &baseString) {
@@ -41,63 +503,346 @@ int stringDistance(const std::string &compareString, const std::string &baseStri
            longestCommonSubsequece(compareString, baseString);
 }
 
+// Both metrics are symmetric, the shorter string is taken as the pattern to use fewer words
 int longestCommonSubsequece(const std::string &str1, const std::string &str2) {
-    int row = str1.length() + 1, column = str2.length() + 1;
-    int i, j;
-
-    std::vector<int> LCS(row * column);
-
-    //LCS[row][column]
-    //LCS[i][j]=Length of longest common subsequence of str1[0....(i-1)] and str2[0...(j-1)]
-
-    //initializing
-    for (i = 0; i < row; i++)
-        LCS[i * column] = 0;    //empty str2
-
-    for (j = 0; j < column; j++)
-        LCS[j] = 0;   //empty str1
-
-    //now, start filling the matrix row wise
-    for (i = 1; i < row; i++) {
-        for (j = 1; j < column; j++) {
-            //if current character of both strings match
-            if (str1[i - 1] == str2[j - 1]) {
-                LCS[i * column + j] = 1 + LCS[(i - 1) * column + (j - 1)];
-            } //mismatch
-            else {
-                LCS[i * column + j] = std::max(LCS[(i - 1) * column + j], LCS[i * column + (j - 1)]);
+    if (str1.size() <= str2.size())
+        return lcsBitParallel<PatternMasks>(str1, str2);
+    return lcsBitParallel<PatternMasks>(str2, str1);
+}
+
+int levenshteinDistance(const std::string &str1, const std::string &str2) {
+    if (str1.size() <= str2.size())
+        return levenshteinBitParallel<PatternMasks>(str1, str2);
+    return levenshteinBitParallel<PatternMasks>(str2, str1);
+}
+
+namespace {
+
+    struct FoldEntry {
+        char32_t from, to;
+    };
+
+    // Lowercases ASCII and Latin-1 letters, built at compile time
+    struct LatinFoldTable {
+        char32_t chars[0x100];
+
+        constexpr LatinFoldTable() : chars() {
+            for (char32_t ch = 0; ch < 0x100; ++ch) {
+                bool upper = (ch >= 'A' && ch <= 'Z') || (ch >= 0xC0 && ch <= 0xDE && ch != 0xD7);
+                chars[ch] = upper ? ch + 0x20 : ch;
             }
+            chars[0xA0] = ' '; // No-break space
+            chars[0xB7] = ' '; // Middle dot, used between names
+        }
+    };
+
+    constexpr LatinFoldTable latinFold;
+
+    // Fullwidth forms U+FF01..U+FF5E, mapped to ASCII and then folded like it
+    struct FullwidthFoldTable {
+        char32_t chars[0x5E];
+
+        constexpr FullwidthFoldTable() : chars() {
+            for (char32_t i = 0; i < 0x5E; ++i)
+                chars[i] = latinFold.chars[0x21 + i];
         }
+    };
+
+    constexpr FullwidthFoldTable fullwidthFold;
+
+    // CJK punctuation to ASCII and common traditional chars to their simplified form, sorted by from
+    constexpr FoldEntry foldEntries[] = {
+            {0x2013, '-'}, {0x2014, '-'}, {0x2018, '\''}, {0x2019, '\''}, {0x201C, '"'}, {0x201D, '"'}, {0x3000, ' '},
+            {0x3001, ','}, {0x3002, '.'}, {0x3008, '<'}, {0x3009, '>'}, {0x300A, '<'}, {0x300B, '>'}, {0x3010, '['},
+            {0x3011, ']'}, {0x301C, '~'}, {0x30FB, ' '}, {U'來', U'来'}, {U'個', U'个'}, {U'們', U'们'}, {U'傷', U'伤'},
+            {U'億', U'亿'}, {U'兒', U'儿'}, {U'劍', U'剑'}, {U'員', U'员'}, {U'問', U'问'}, {U'單', U'单'}, {U'嗎', U'吗'},
+            {U'嚴', U'严'}, {U'國', U'国'}, {U'園', U'园'}, {U'圓', U'圆'}, {U'團', U'团'}, {U'場', U'场'}, {U'墜', U'坠'},
+            {U'壓', U'压'}, {U'壞', U'坏'}, {U'夠', U'够'}, {U'夢', U'梦'}, {U'學', U'学'}, {U'實', U'实'}, {U'寫', U'写'},
+            {U'將', U'将'}, {U'專', U'专'}, {U'對', U'对'}, {U'島', U'岛'}, {U'師', U'师'}, {U'幾', U'几'}, {U'廣', U'广'},
+            {U'後', U'后'}, {U'從', U'从'}, {U'悅', U'悦'}, {U'愛', U'爱'}, {U'態', U'态'}, {U'憂', U'忧'}, {U'憐', U'怜'},
+            {U'憑', U'凭'}, {U'憶', U'忆'}, {U'懷', U'怀'}, {U'戀', U'恋'}, {U'戰', U'战'}, {U'戲', U'戏'}, {U'揮', U'挥'},
+            {U'擁', U'拥'}, {U'時', U'时'}, {U'曇', U'昙'}, {U'曉', U'晓'}, {U'書', U'书'}, {U'會', U'会'}, {U'東', U'东'},
+            {U'業', U'业'}, {U'樂', U'乐'}, {U'歎', U'叹'}, {U'歡', U'欢'}, {U'歲', U'岁'}, {U'歷', U'历'}, {U'歸', U'归'},
+            {U'氣', U'气'}, {U'淚', U'泪'}, {U'淺', U'浅'}, {U'溫', U'温'}, {U'滿', U'满'}, {U'漢', U'汉'}, {U'漸', U'渐'},
+            {U'灣', U'湾'}, {U'為', U'为'}, {U'無', U'无'}, {U'煙', U'烟'}, {U'熱', U'热'}, {U'燈', U'灯'}, {U'猶', U'犹'},
+            {U'畫', U'画'}, {U'異', U'异'}, {U'療', U'疗'}, {U'癒', U'愈'}, {U'發', U'发'}, {U'盡', U'尽'}, {U'禮', U'礼'},
+            {U'筆', U'笔'}, {U'紀', U'纪'}, {U'約', U'约'}, {U'紅', U'红'}, {U'純', U'纯'}, {U'終', U'终'}, {U'結', U'结'},
+            {U'給', U'给'}, {U'經', U'经'}, {U'綠', U'绿'}, {U'線', U'线'}, {U'緣', U'缘'}, {U'縛', U'缚'}, {U'總', U'总'},
+            {U'織', U'织'}, {U'繪', U'绘'}, {U'羅', U'罗'}, {U'義', U'义'}, {U'聖', U'圣'}, {U'聞', U'闻'}, {U'聯', U'联'},
+            {U'聲', U'声'}, {U'聽', U'听'}, {U'膽', U'胆'}, {U'臉', U'脸'}, {U'與', U'与'}, {U'興', U'兴'}, {U'舉', U'举'},
+            {U'舊', U'旧'}, {U'莊', U'庄'}, {U'華', U'华'}, {U'萬', U'万'}, {U'葉', U'叶'}, {U'藍', U'蓝'}, {U'藝', U'艺'},
+            {U'蘭', U'兰'}, {U'處', U'处'}, {U'虛', U'虚'}, {U'號', U'号'}, {U'術', U'术'}, {U'裡', U'里'}, {U'見', U'见'},
+            {U'規', U'规'}, {U'視', U'视'}, {U'親', U'亲'}, {U'覺', U'觉'}, {U'觀', U'观'}, {U'記', U'记'}, {U'訴', U'诉'},
+            {U'詞', U'词'}, {U'詠', U'咏'}, {U'詩', U'诗'}, {U'話', U'话'}, {U'認', U'认'}, {U'語', U'语'}, {U'誤', U'误'},
+            {U'說', U'说'}, {U'誰', U'谁'}, {U'請', U'请'}, {U'謎', U'谜'}, {U'謝', U'谢'}, {U'證', U'证'}, {U'識', U'识'},
+            {U'讀', U'读'}, {U'變', U'变'}, {U'讓', U'让'}, {U'貝', U'贝'}, {U'負', U'负'}, {U'買', U'买'}, {U'賞', U'赏'},
+            {U'賣', U'卖'}, {U'贈', U'赠'}, {U'趕', U'赶'}, {U'輕', U'轻'}, {U'輝', U'辉'}, {U'輪', U'轮'}, {U'轉', U'转'},
+            {U'農', U'农'}, {U'這', U'这'}, {U'遊', U'游'}, {U'運', U'运'}, {U'過', U'过'}, {U'達', U'达'}, {U'違', U'违'},
+            {U'遠', U'远'}, {U'選', U'选'}, {U'遺', U'遗'}, {U'還', U'还'}, {U'邊', U'边'}, {U'鄉', U'乡'}, {U'錄', U'录'},
+            {U'錯', U'错'}, {U'鎖', U'锁'}, {U'鐘', U'钟'}, {U'長', U'长'}, {U'門', U'门'}, {U'閃', U'闪'}, {U'閉', U'闭'},
+            {U'開', U'开'}, {U'間', U'间'}, {U'闖', U'闯'}, {U'關', U'关'}, {U'陣', U'阵'}, {U'陰', U'阴'}, {U'陸', U'陆'},
+            {U'陽', U'阳'}, {U'隊', U'队'}, {U'際', U'际'}, {U'隨', U'随'}, {U'隱', U'隐'}, {U'隻', U'只'}, {U'雖', U'虽'},
+            {U'雙', U'双'}, {U'雞', U'鸡'}, {U'離', U'离'}, {U'難', U'难'}, {U'雲', U'云'}, {U'電', U'电'}, {U'靈', U'灵'},
+            {U'靜', U'静'}, {U'韻', U'韵'}, {U'響', U'响'}, {U'頁', U'页'}, {U'順', U'顺'}, {U'須', U'须'}, {U'領', U'领'},
+            {U'頭', U'头'}, {U'顏', U'颜'}, {U'願', U'愿'}, {U'顛', U'颠'}, {U'風', U'风'}, {U'飄', U'飘'}, {U'飛', U'飞'},
+            {U'館', U'馆'}, {U'馬', U'马'}, {U'驚', U'惊'}, {U'體', U'体'}, {U'髮', U'发'}, {U'鬥', U'斗'}, {U'鬧', U'闹'},
+            {U'魚', U'鱼'}, {U'鳥', U'鸟'}, {U'鳳', U'凤'}, {U'鳴', U'鸣'}, {U'麗', U'丽'}, {U'麥', U'麦'}, {U'麼', U'么'},
+            {U'黃', U'黄'}, {U'點', U'点'}, {U'齊', U'齐'}, {U'齒', U'齿'}, {U'龍', U'龙'}
+    };
+
+    constexpr bool foldEntriesSorted() {
+        for (size_t i = 1; i < std::size(foldEntries); ++i) {
+            if (foldEntries[i - 1].from >= foldEntries[i].from)
+                return false;
+        }
+        return true;
     }
 
-    //now, return the final value
-    return LCS[(row - 1) * column + (column - 1)];
-}
+    static_assert(foldEntriesSorted(), "foldEntries has to be sorted for the binary search");
 
-int levenshteinDistance(const std::string &str1, const std::string &str2) {
-    int cost, row = str1.length() + 1, column = str2.length() + 1;
+    inline char32_t foldChar(char32_t ch) {
+        if (ch < 0x100)
+            return latinFold.chars[ch];
+        if (ch >= 0xFF01 && ch <= 0xFF5E)
+            return fullwidthFold.chars[ch - 0xFF01];
+        if (ch < foldEntries[0].from)
+            return ch;
+        auto entry = std::lower_bound(std::begin(foldEntries), std::end(foldEntries), ch,
+                                      [](const FoldEntry &entry, char32_t ch) { return entry.from < ch; });
+        return (entry != std::end(foldEntries) && entry->from == ch) ? entry->to : ch;
+    }
+
+    // Decodes into chars, which needs room for str.size() code points, returns the number of code points
+    size_t decodeChars(std::string_view str, bool fold, char32_t *chars) {
+        size_t count = 0;
+        for (size_t pos = 0; pos < str.size();) {
+            char32_t ch = utf8NextChar(str, pos);
+            chars[count++] = fold ? foldChar(ch) : ch;
+        }
+        return count;
+    }
 
-    std::vector<int> distance(row * column);
+    using CharBuffer = StackBuffer<char32_t, 128>;
 
-    for (int i = 0; i < column; ++i) {
-        distance[i * row] = i;
+    // levenshteinDistance over code points, maxDistance + 1 if it exceeds maxDistance. The length difference
+    // alone is a lower bound, which spares the kernel for strings far apart in length.
+    int boundedLevenshtein(std::u32string_view str1, std::u32string_view str2, int maxDistance) {
+        if (str1.size() > str2.size())
+            std::swap(str1, str2);
+        if (maxDistance < 0 || str2.size() - str1.size() > static_cast<size_t>(maxDistance))
+            return maxDistance + 1;
+        int distance = levenshteinBitParallel<CodepointMasks>(str1, str2);
+        return distance > maxDistance ? maxDistance + 1 : distance;
     }
-    for (int j = 0; j < row; ++j) {
-        distance[j] = j;
+
+    // stringDistance over code points, the LCS term is never negative,
+    // so the edit distance alone may already exceed the bound
+    int boundedStringDistance(std::u32string_view compareChars, std::u32string_view baseChars, int maxDistance) {
+        int distance = boundedLevenshtein(compareChars, baseChars, maxDistance);
+        if (distance > maxDistance)
+            return maxDistance + 1;
+        distance += static_cast<int>(baseChars.size()) - (compareChars.size() <= baseChars.size()
+                                                          ? lcsBitParallel<CodepointMasks>(compareChars, baseChars)
+                                                          : lcsBitParallel<CodepointMasks>(baseChars, compareChars));
+        return distance > maxDistance ? maxDistance + 1 : distance;
     }
-    for (int i = 1; i < column; ++i) {
-        for (int j = 1; j < row; ++j) {
-            if (str2[i - 1] == str1[j - 1]) cost = 0;
-            else cost = 1;
-            distance[i * row + j] = std::min({
-                                                     distance[(i - 1) * row + j] + 1,
-                                                     distance[i * row + (j - 1)] + 1,
-                                                     distance[(i - 1) * row + (j - 1)] + cost,
-                                             });
+
+    // Removes "feat. X" credits, up to the closing bracket if they are bracketed and to the end otherwise
+    void stripFeaturing(std::u32string &chars) {
+        static constexpr std::u32string_view markers[] = {U"feat.", U"feat ", U"featuring ", U"ft."};
+        for (size_t i = 1; i < chars.size(); ++i) {
+            char32_t before = chars[i - 1];
+            if (before != ' ' && before != '(' && before != '[')
+                continue;
+            bool found = std::any_of(std::begin(markers), std::end(markers), [&chars, i](std::u32string_view marker) {
+                return chars.compare(i, marker.size(), marker.data(), marker.size()) == 0;
+            });
+            if (!found)
+                continue;
+            if (before == ' ') {
+                chars.erase(i - 1);
+                return;
+            }
+            size_t end = chars.find(before == '(' ? ')' : ']', i);
+            chars.erase(i - 1, end == std::u32string::npos ? std::u32string::npos : end - i + 2);
+            --i;
+        }
+    }
+
+    // Trims and collapses whitespace runs into one space
+    void collapseSpaces(std::u32string &chars) {
+        size_t length = 0;
+        for (char32_t ch: chars) {
+            bool space = ch == ' ' || ch == '\t';
+            if (space && (length == 0 || chars[length - 1] == ' '))
+                continue;
+            chars[length++] = space ? ' ' : ch;
         }
+        if (length > 0 && chars[length - 1] == ' ')
+            --length;
+        chars.resize(length);
     }
 
-    return distance[(column - 1) * row + (row - 1)];
+}
+
+std::u32string utf8Decode(std::string_view str, bool fold) {
+    std::u32string chars(str.size(), 0);
+    chars.resize(decodeChars(str, fold, chars.data()));
+    return chars;
+}
+
+std::string utf8Encode(std::u32string_view chars) {
+    std::string str;
+    str.reserve(chars.size());
+    for (char32_t ch: chars) {
+        if (ch < 0x80) {
+            str.push_back(static_cast<char>(ch));
+        } else if (ch < 0x800) {
+            str.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+            str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+        } else if (ch < 0x10000) {
+            str.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+            str.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+        } else {
+            str.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+            str.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+        }
+    }
+    return str;
+}
+
+int codepointDistance(std::string_view str1, std::string_view str2, int maxDistance, bool fold) {
+    CharBuffer chars1(str1.size(), 0), chars2(str2.size(), 0);
+    size_t length1 = decodeChars(str1, fold, chars1.get()), length2 = decodeChars(str2, fold, chars2.get());
+    return boundedLevenshtein({chars1.get(), length1}, {chars2.get(), length2}, maxDistance);
+}
+
+int codepointStringDistance(std::string_view compareString, std::string_view baseString, int maxDistance,
+                            bool fold) {
+    CharBuffer compareChars(compareString.size(), 0), baseChars(baseString.size(), 0);
+    size_t compareLength = decodeChars(compareString, fold, compareChars.get());
+    size_t baseLength = decodeChars(baseString, fold, baseChars.get());
+    return boundedStringDistance({compareChars.get(), compareLength}, {baseChars.get(), baseLength}, maxDistance);
+}
+
+MatchKey::MatchKey(std::string_view str) : chars(utf8Decode(str, true)) {
+    stripFeaturing(chars);
+    collapseSpaces(chars);
+}
+
+int matchDistance(const MatchKey &compareKey, const MatchKey &baseKey, int maxDistance) {
+    return boundedStringDistance(compareKey.str(), baseKey.str(), maxDistance);
+}
+
+int maxTrackDistance(const MatchKey &targetTitle, const MatchKey &targetArtist) {
+    return static_cast<int>(targetTitle.size() + targetArtist.size() / 2);
+}
+
+int trackDistance(const MatchKey &title, const MatchKey &artist, const MatchKey &targetTitle,
+                  const MatchKey &targetArtist) {
+    int maxDistance = maxTrackDistance(targetTitle, targetArtist);
+    int distance = matchDistance(title, targetTitle, maxDistance);
+    if (distance > maxDistance)
+        return maxDistance + 1;
+    // Half of the artist distance counts, so it may use twice the remaining bound
+    int artistDistance = matchDistance(artist, targetArtist, (maxDistance - distance) * 2 + 1);
+    return std::min(distance + artistDistance / 2, maxDistance + 1);
+}
+
+namespace {
+
+    enum NameCharClass : uint8_t {
+        nameSpecialChar = 1,  // ASCII punctuation, replaced by normalizeName
+        fileNameUnsafe = 2,   // Not allowed in file names on some platform, replaced by normalizeFileName
+        urlUnreserved = 4     // Kept as is by URL escaping
+    };
+
+    struct NameCharTable {
+        uint8_t classes[256];
+
+        constexpr NameCharTable() : classes() {
+            for (unsigned ch = 0x21; ch < 0x7F; ++ch) {
+                bool alnum = (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+                if (!alnum)
+                    classes[ch] |= nameSpecialChar;
+                if (alnum || ch == '-' || ch == '.' || ch == '_' || ch == '~')
+                    classes[ch] |= urlUnreserved;
+            }
+            for (char ch: {'/', '\\', '?', '%', '*', ':', '|', '"', '<', '>'})
+                classes[static_cast<unsigned char>(ch)] |= fileNameUnsafe;
+        }
+    };
+
+    constexpr NameCharTable nameChars;
+
+    // Length of the prefix which has no ASCII punctuation, or with alnumOnly no byte other than ASCII letters
+    // and digits. Such bytes are copied as they are by both normalizations.
+    size_t plainPrefix(const char *data, size_t size, bool alnumOnly) {
+        size_t pos = 0;
+#ifdef CLYRIC_UTF8_X86
+        const __m128i digitLow = _mm_set1_epi8('0' - 1), digitHigh = _mm_set1_epi8('9' + 1);
+        const __m128i letterLow = _mm_set1_epi8('a' - 1), letterHigh = _mm_set1_epi8('z' + 1);
+        const __m128i lowerBit = _mm_set1_epi8(0x20), space = _mm_set1_epi8(' ' + 1), del = _mm_set1_epi8(0x7F);
+        for (; pos + 16 <= size; pos += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+            // Bytes from 0x80 are negative, so they fail both range checks
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, digitLow), _mm_cmplt_epi8(chunk, digitHigh));
+            __m128i lower = _mm_or_si128(chunk, lowerBit);
+            __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, letterLow), _mm_cmplt_epi8(lower, letterHigh));
+            __m128i plain = _mm_or_si128(digit, letter);
+            if (!alnumOnly) // Controls, space, DEL and non-ASCII bytes are not punctuation
+                plain = _mm_or_si128(plain, _mm_or_si128(_mm_cmplt_epi8(chunk, space), _mm_cmpeq_epi8(chunk, del)));
+            if (_mm_movemask_epi8(plain) != 0xFFFF)
+                break; // The scalar loop finds the byte within the chunk
+        }
+#endif
+        for (; pos < size; ++pos) {
+            uint8_t classes = nameChars.classes[static_cast<unsigned char>(data[pos])];
+            bool alnum = (classes & urlUnreserved) && !(classes & nameSpecialChar);
+            if (alnumOnly ? !alnum : (classes & nameSpecialChar))
+                break;
+        }
+        return pos;
+    }
+
+    // Replaces the chars of replaceClass with spaces and percent-encodes the result if urlEscape is set,
+    // in one pass over str
+    std::string normalizeChars(std::string_view str, uint8_t replaceClass, bool urlEscape) {
+        static constexpr char hexDigits[] = "0123456789ABCDEF";
+        std::string result;
+        result.reserve(urlEscape ? str.size() * 3 : str.size());
+        for (size_t pos = 0; pos < str.size();) {
+            size_t plain = plainPrefix(str.data() + pos, str.size() - pos, urlEscape);
+            result.append(str.data() + pos, plain);
+            pos += plain;
+            if (pos == str.size())
+                break;
+
+            auto ch = static_cast<unsigned char>(str[pos++]);
+            if (nameChars.classes[ch] & replaceClass)
+                ch = ' ';
+            if (urlEscape && !(nameChars.classes[ch] & urlUnreserved)) {
+                result.push_back('%');
+                result.push_back(hexDigits[ch >> 4u]);
+                result.push_back(hexDigits[ch & 0xFu]);
+            } else {
+                result.push_back(static_cast<char>(ch));
+            }
+        }
+        return result;
+    }
+
+}
+
+std::string normalizeName(std::string_view str, bool urlEscape, bool noSpecialChars) {
+    return normalizeChars(str, noSpecialChars ? nameSpecialChar : 0, urlEscape);
+}
+
+std::string normalizeFileName(std::string_view name) {
+    return normalizeChars(name, fileNameUnsafe, false);
 }
 
 std::vector<std::string> split_string(const std::string &str, const std::string &delimiter) {
@@ -177,3 +922,16 @@ bool zlibInflate(const std::string &compressed, std::string &uncompressed) {
     delete[] uncomp;
     return true;
 }
+
+bool zlibDeflate(const std::string &uncompressed, std::string &compressed) {
+    uLongf length = compressBound(static_cast<uLong>(uncompressed.size()));
+    compressed.resize(length);
+    if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &length,
+                  reinterpret_cast<const Bytef *>(uncompressed.data()), static_cast<uLong>(uncompressed.size()),
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+        compressed.clear();
+        return false;
+    }
+    compressed.resize(length);
+    return true;
+}
@@ -7,11 +7,33 @@
 #define CRYSTALLYRICS_CLYRICUTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <climits>
 
-size_t utf8StringChars(const std::string &str);
+// UTF-8 helpers, vectorized on x86-64 (SSE2/SSSE3/AVX2 picked at runtime) with scalar fallbacks.
+// Chars are code points, malformed bytes never make them read past the end of the string.
+
+// Number of code points, i.e. bytes which are not continuation bytes
+size_t utf8StringChars(std::string_view str);
+
+size_t utf8StringCharsScalar(std::string_view str);
+
+// Rejects overlong forms, surrogates, code points above U+10FFFF and truncated sequences
+bool utf8Validate(std::string_view str);
+
+bool utf8ValidateScalar(std::string_view str);
+
+// Byte offset of the code point at index chars, str.size() if there are not so many
+size_t utf8CharsToBytes(std::string_view str, size_t chars);
+
+constexpr char32_t utf8ReplacementChar = 0xFFFD;
+
+// Decodes the code point at pos and advances pos past it,
+// a malformed sequence yields utf8ReplacementChar and advances by one byte
+char32_t utf8NextChar(std::string_view str, size_t &pos);
 
 int stringDistance(const std::string &compareString, const std::string &baseString);
 
@@ -19,10 +41,59 @@ int longestCommonSubsequece(const std::string &str1, const std::string &str2);
 
 int levenshteinDistance(const std::string &str1, const std::string &str2);
 
+// Code point based distances for ranking titles, where the byte based ones count a CJK char as three.
+// With fold, chars are folded like in MatchKey.
+
+std::u32string utf8Decode(std::string_view str, bool fold = false);
+
+std::string utf8Encode(std::u32string_view chars);
+
+// Levenshtein distance over code points by the same bit-parallel kernel, maxDistance + 1 if it exceeds maxDistance
+int codepointDistance(std::string_view str1, std::string_view str2, int maxDistance = INT_MAX, bool fold = false);
+
+// stringDistance over code points, bounded like codepointDistance
+int codepointStringDistance(std::string_view compareString, std::string_view baseString,
+                            int maxDistance = INT_MAX, bool fold = false);
+
+// Decoded and normalized form of a title or artist, built once per string and compared by the functions below.
+// Chars are folded by compile time tables: case, fullwidth forms, CJK punctuation and common traditional chars
+// to simplified ones. "feat." credits are removed and whitespace is collapsed.
+class MatchKey {
+    std::u32string chars;
+
+public:
+    MatchKey() = default;
+
+    explicit MatchKey(std::string_view str);
+
+    [[nodiscard]] const std::u32string &str() const { return chars; }
+
+    [[nodiscard]] size_t size() const { return chars.size(); }
+
+    [[nodiscard]] bool empty() const { return chars.empty(); }
+
+    bool operator==(const MatchKey &key) const { return chars == key.chars; }
+
+    bool operator!=(const MatchKey &key) const { return chars != key.chars; }
+};
+
+// codepointStringDistance of two keys
+int matchDistance(const MatchKey &compareKey, const MatchKey &baseKey, int maxDistance = INT_MAX);
+
+// Distance of a search result to the searched track, the title distance plus half the artist distance.
+// Results further than maxTrackDistance are not worth fetching, their distance is maxTrackDistance + 1.
+int trackDistance(const MatchKey &title, const MatchKey &artist, const MatchKey &targetTitle,
+                  const MatchKey &targetArtist);
+
+int maxTrackDistance(const MatchKey &targetTitle, const MatchKey &targetArtist);
+
 std::vector<std::string> split_string(const std::string &str, const std::string &delimiter);
 
 bool zlibInflate(const std::string &compressed, std::string &uncompressed);
 
+// Compresses into the zlib format read by zlibInflate
+bool zlibDeflate(const std::string &uncompressed, std::string &compressed);
+
 template<typename T>
 inline std::vector<size_t> sort_indexes(const std::vector<T> &v) {
 
@@ -40,28 +111,12 @@ inline std::vector<size_t> sort_indexes(const std::vector<T> &v) {
     return idx;
 }
 
-inline std::string normalizeFileName(std::string name) {
-    for (auto &c: name) {
-        if (static_cast<unsigned char>(c) > 127) {
-            // Non-Ascii char
-            continue;
-        }
-        switch (c) {
-            case '/':
-            case '\\':
-            case '?':
-            case '%':
-            case '*':
-            case ':':
-            case '|':
-            case '"':
-            case '<':
-            case '>':
-                c = ' ';
-        }
-    }
-    return name;
-}
+// Replaces ASCII punctuation with spaces if noSpecialChars is set and percent-encodes the result like
+// curl_easy_escape if urlEscape is set, both in one table driven pass. Non-ASCII bytes are kept unless escaped.
+std::string normalizeName(std::string_view str, bool urlEscape = false, bool noSpecialChars = true);
+
+// Replaces chars which are not allowed in file names with spaces
+std::string normalizeFileName(std::string_view name);
 
 // trim from left
 inline std::string &ltrim(std::string &s, const char *t = " \t\n\r\f\v") {
@@ -5,8 +5,31 @@
 
 #include "../CLyric.h"
 #include "../CLyricProvider.h"
+#include "../CLyricParser.h"
+#include "../CLyricCompact.h"
+#include "../CLyricBinary.h"
+#include "../CLyricLibrary.h"
+#include "../CLyricUtils.h"
+#include "../CLyricTimeline.h"
+#include "../CLyricKaraoke.h"
+#include "../CLyricRanker.h"
+#include "../CLyricConnectionPool.h"
+#include "../CLyricCancellation.h"
+#include "../CLyricResponseCache.h"
+#include "../CLyricNegativeCache.h"
+#include "../CLyricProviderHealth.h"
+#include "../CLyricSearch.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cctype>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 
 using namespace cLyric;
 
@@ -124,4 +147,1065 @@ TEST(CLyricTests, CLyricXiamiParseTest) {
     CLyric lyric(contextTest, LyricStyle::XiamiStyle);
 
     EXPECT_STREQ(lyric.lyrics[0].translation.c_str(), "作词：cittan*") << "Xiami Lyric Translation Test Failed";
-}
\ No newline at end of file
+}
+
+TEST(CLyricTests, CLyricTimeTagVariantsParseTest) {
+    std::string contentText = R"([ti]Variants
+[01:02:03.45]Hour
+[100:01.5]Long Minutes
+[00:01]No Milliseconds
+[00:02.]Empty Milliseconds
+)";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+
+    std::vector<int> startTimes;
+    for (auto &item : lyric.lyrics) {
+        startTimes.push_back(item.startTime);
+    }
+
+    EXPECT_EQ(startTimes, std::vector<int>({1000, 2000, 3723450, 6001500})) << "Lyric Time Tag Variants Test Failed";
+}
+
+TEST(CLyricTests, CLyricEquivalentTimeTagsMergeTest) {
+    std::string contentText = R"([ti]Equivalent
+[01:02]Content
+[01:02.0][tr]Translation
+[00:01:02.000][tc]0,2|500,3
+[00:10.00][01:02.00]Chorus
+[00:10]
+)";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+
+    ASSERT_EQ(lyric.lyrics.size(), 2) << "Lyric Equivalent Time Tags Merge Test Failed";
+    EXPECT_EQ(lyric.lyrics[0].startTime, 10000) << "Lyric Equivalent Time Tags Merge Test Failed";
+    EXPECT_EQ(lyric.lyrics[0].content, "Chorus") << "Lyric Equivalent Time Tags Merge Test Failed";
+    EXPECT_EQ(lyric.lyrics[1].startTime, 62000) << "Lyric Equivalent Time Tags Merge Test Failed";
+    EXPECT_EQ(lyric.lyrics[1].content, "Content") << "Lyric Equivalent Time Tags Merge Test Failed";
+    EXPECT_EQ(lyric.lyrics[1].translation, "Translation") << "Lyric Equivalent Time Tags Merge Test Failed";
+    std::vector<std::pair<int, int>> timecodes{{0, 2}, {500, 3}};
+    EXPECT_EQ(lyric.lyrics[1].timecodes, timecodes) << "Lyric Equivalent Time Tags Merge Test Failed";
+}
+
+TEST(CLyricTests, CLyricLongLineParseTest) {
+    std::string longContent(1000, 'a');
+    std::string contentText = "[ti]Long\n[00:01.00]" + longContent + "\n[00:01.00][tr]" + longContent + "\n";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+
+    ASSERT_EQ(lyric.lyrics.size(), 1) << "Long Lyric Line Count Test Failed";
+    EXPECT_EQ(lyric.lyrics[0].content, longContent) << "Long Lyric Line Content Test Failed";
+    EXPECT_EQ(lyric.lyrics[0].translation, longContent) << "Long Lyric Line Translation Test Failed";
+}
+
+TEST(CLyricTests, CLyricStreamParserTest) {
+    std::string contentText = "[ti]海阔天空\r\n[ar]Beyond\r\n"
+                              "[01:09.00]原谅我这一生不羁放纵爱自由\r\n[01:09.00][tr]翻译\r\n"
+                              "[01:16.00]也会怕有一天会跌倒\r\n"
+                              "[02:08.00][00:10.00]被弃了理想谁人都可以";
+
+    CLyric baseLyric(contentText, LyricStyle::CLrcStyle);
+
+    for (size_t chunkSize: {1, 2, 5, 64}) {
+        std::vector<int> emittedStartTimes;
+        CLyricStreamParser parser(LyricStyle::CLrcStyle, [&](const CLyricItem &item) {
+            emittedStartTimes.push_back(item.startTime);
+        });
+        for (size_t i = 0; i < contentText.size(); i += chunkSize) {
+            parser.feed(std::string_view(contentText).substr(i, chunkSize));
+        }
+        CLyric lyric = parser.finish();
+
+        EXPECT_EQ(parser.front(), '[') << "Stream Parser First Byte Test Failed";
+        EXPECT_EQ(lyric.track.title, baseLyric.track.title) << "Stream Parser Title Test Failed";
+        ASSERT_EQ(lyric.lyrics.size(), baseLyric.lyrics.size()) << "Stream Parser Item Count Test Failed";
+        for (size_t i = 0; i < lyric.lyrics.size(); ++i) {
+            EXPECT_EQ(lyric.lyrics[i].content, baseLyric.lyrics[i].content) << "Stream Parser Content Test Failed";
+            EXPECT_EQ(lyric.lyrics[i].translation, baseLyric.lyrics[i].translation)
+                                << "Stream Parser Translation Test Failed";
+            EXPECT_EQ(lyric.lyrics[i].startTime, baseLyric.lyrics[i].startTime)
+                                << "Stream Parser Start Time Test Failed";
+        }
+
+        std::sort(emittedStartTimes.begin(), emittedStartTimes.end());
+        EXPECT_EQ(emittedStartTimes, std::vector<int>({10000, 69000, 76000, 128000}))
+                            << "Stream Parser Item Callback Test Failed";
+    }
+}
+
+TEST(CLyricTests, CLyricStreamParserBadTagsTest) {
+    // Bad values keep the ones parsed before them, the parser runs inside the write callback of curl and must not throw
+    std::string contentText = "[du]215\n[offset]+40\n[offset:abc]\n[du:99999999999]\n[offset]abc\n[du]99999999999\n"
+                              "[00:01.00]Line";
+
+    CLyricStreamParser parser(LyricStyle::CLrcStyle);
+    EXPECT_NO_THROW(parser.feed(contentText)) << "Stream Parser Bad Tags Throw Test Failed";
+    CLyric lyric = parser.finish();
+
+    EXPECT_EQ(lyric.track.duration, 215) << "Stream Parser Bad Duration Test Failed";
+    EXPECT_EQ(lyric.offset, 40) << "Stream Parser Bad Offset Test Failed";
+    EXPECT_EQ(lyric.lyrics.size(), 1) << "Stream Parser Bad Tags Item Count Test Failed";
+}
+
+TEST(CLyricTests, CLyricCompactConversionTest) {
+    std::string contentText = R"([ti]海阔天空
+[ar]Beyond
+[offset]-120
+[01:09.00]原谅我这一生不羁放纵爱自由
+[01:09.00][tr]翻译
+[01:09.00][tc]0,0|500,3|1000,14
+[01:16.00]也会怕有一天会跌倒
+)";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+    CLyricCompact compactLyric(lyric);
+
+    ASSERT_EQ(compactLyric.size(), lyric.lyrics.size()) << "Compact Lyric Item Count Test Failed";
+    EXPECT_EQ(compactLyric.content(0), "原谅我这一生不羁放纵爱自由") << "Compact Lyric Content Test Failed";
+    EXPECT_EQ(compactLyric.translation(0), "翻译") << "Compact Lyric Translation Test Failed";
+    EXPECT_EQ(compactLyric.translation(1), "") << "Compact Lyric Empty Translation Test Failed";
+    EXPECT_EQ(compactLyric.timecodesEnd(0) - compactLyric.timecodesBegin(0), 3)
+                        << "Compact Lyric Time Codes Test Failed";
+    EXPECT_TRUE(compactLyric.hasTranslation() && compactLyric.hasTimecodes()) << "Compact Lyric Flags Test Failed";
+
+    CLyric convertedLyric = compactLyric.toCLyric();
+    EXPECT_EQ(convertedLyric.readableString(), lyric.readableString()) << "Compact Lyric Round Trip Test Failed";
+    CLyricCompact copiedLyric = compactLyric;
+    EXPECT_EQ(copiedLyric.toCLyric().readableString(), lyric.readableString()) << "Compact Lyric Copy Test Failed";
+}
+
+TEST(CLyricTests, CLyricBinaryCacheTest) {
+    std::string contentText = R"([ti]海阔天空
+[al]乐与怒
+[ar]Beyond
+[du]326
+[offset]-120
+[01:09.00]原谅我这一生不羁放纵爱自由
+[01:09.00][tr]翻译
+[01:09.00][tc]0,0|500,3|1000,14|900,2
+[01:16.00]也会怕有一天会跌倒
+)";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+    auto directory = std::filesystem::temp_directory_path() / "CLyricBinaryCacheTest";
+    std::filesystem::create_directories(directory);
+    lyric.saveToFile(directory.u8string());
+    std::string textPath = (directory / lyric.filename()).u8string();
+
+    CLyricBinary binary;
+    ASSERT_TRUE(binary.open(binaryCachePath(textPath))) << "Binary Cache Open Test Failed";
+    ASSERT_EQ(binary.size(), 2) << "Binary Cache Item Count Test Failed";
+    EXPECT_EQ(binary.startTime(1), 76000) << "Binary Cache Start Time Test Failed";
+    EXPECT_EQ(binary.translation(0), "翻译") << "Binary Cache Translation Test Failed";
+    binary.close();
+
+    CLyric cachedLyric;
+    ASSERT_TRUE(loadBinaryCache(textPath, cachedLyric)) << "Binary Cache Load Test Failed";
+    EXPECT_EQ(cachedLyric.readableString(), lyric.readableString()) << "Binary Cache Round Trip Test Failed";
+
+    // A changed .clrc file makes the cache stale
+    std::ofstream(std::filesystem::u8path(textPath), std::ios::app) << "[01:20.00]Appended\n";
+    EXPECT_FALSE(loadBinaryCache(textPath, cachedLyric)) << "Binary Cache Stale Test Failed";
+
+    // Corrupted caches are rejected
+    saveBinaryCache(lyric, textPath);
+    {
+        std::fstream binaryFile(std::filesystem::u8path(binaryCachePath(textPath)),
+                                std::ios::in | std::ios::out | std::ios::binary);
+        binaryFile.seekp(-1, std::ios::end);
+        binaryFile.put('\xFF');
+    }
+    EXPECT_FALSE(binary.open(binaryCachePath(textPath))) << "Binary Cache Corruption Test Failed";
+
+    lyric.deleteFile(directory.u8string());
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::u8path(binaryCachePath(textPath))))
+                        << "Binary Cache Delete Test Failed";
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricLibraryLoadTest) {
+    auto directory = std::filesystem::temp_directory_path() / "CLyricLibraryLoadTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    for (int i = 0; i < 100; ++i) {
+        CLyric lyric(Track("Title " + std::to_string(i), "Album", "Artist"),
+                     {CLyricItem("Content", 1000), CLyricItem("Content", 2000)});
+        lyric.saveToFile(directory.u8string());
+    }
+    std::ofstream(directory / "Invalid.clrc") << "[00:01.00]No Title\n";
+    std::ofstream(directory / "Broken.clrc") << "[ti]Broken\n[00:01.00]\xff\xfe\n";
+    std::ofstream(directory / "Other.txt") << "[ti]Other\n";
+
+    std::vector<CLyricLibraryEntry> entries;
+    std::atomic<int> callbackCount = 0;
+    CLyricLibraryStats stats = CLyricLibrary(directory.u8string()).load(
+            entries, [&callbackCount](const CLyricLibraryEntry &, const CLyric &) { ++callbackCount; }, 4);
+
+    EXPECT_EQ(stats.files, 102) << "Lyric Library File Count Test Failed";
+    EXPECT_EQ(stats.validFiles, 100) << "Lyric Library Valid Files Test Failed";
+    EXPECT_EQ(stats.invalidFiles, 1) << "Lyric Library Invalid Files Test Failed";
+    EXPECT_EQ(stats.failedFiles, 1) << "Lyric Library Failed Files Test Failed";
+    EXPECT_EQ(callbackCount, 101) << "Lyric Library Callback Test Failed";
+    EXPECT_TRUE(std::is_sorted(entries.begin(), entries.end(),
+                               [](const CLyricLibraryEntry &entry1, const CLyricLibraryEntry &entry2) {
+                                   return entry1.path < entry2.path;
+                               })) << "Lyric Library Entry Order Test Failed";
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricUtf8Test) {
+    std::string text = "原谅我这一生 不羁放纵爱自由 🎵 Beyond";
+    EXPECT_EQ(utf8StringChars(text), 23) << "UTF-8 Char Count Test Failed";
+    EXPECT_TRUE(utf8Validate(text)) << "UTF-8 Validation Test Failed";
+    EXPECT_EQ(utf8CharsToBytes(text, 7), 19) << "UTF-8 Char Offset Test Failed";
+    EXPECT_EQ(utf8CharsToBytes(text, 100), text.size()) << "UTF-8 Char Offset Overflow Test Failed";
+
+    std::vector<char32_t> chars;
+    for (size_t pos = 0; pos < text.size();)
+        chars.push_back(utf8NextChar(text, pos));
+    EXPECT_EQ(chars.size(), 23) << "UTF-8 Char Iteration Test Failed";
+    EXPECT_EQ(chars[15], U'🎵') << "UTF-8 Char Iteration Test Failed";
+
+    for (const char *invalid: {"\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xE5\x8E", "\x80",
+                               "abc\xF0\x9F\x8E"}) {
+        EXPECT_FALSE(utf8Validate(invalid)) << "UTF-8 Invalid Sequence Test Failed";
+    }
+
+    // Vectorized routines must agree with the scalar ones, including malformed input
+    std::mt19937 random(42);
+    std::vector<std::string> pieces = {"a", " ", "原", "谅", "é", "🎵", "\x80", "\xE5\x8E", "\xF0", "\xC3"};
+    for (int i = 0; i < 2000; ++i) {
+        std::string str;
+        size_t pieceCount = random() % 80;
+        for (size_t j = 0; j < pieceCount; ++j)
+            str += pieces[random() % (i % 2 ? pieces.size() : 6)];
+        ASSERT_EQ(utf8StringChars(str), utf8StringCharsScalar(str)) << "UTF-8 Char Count Consistency Test Failed";
+        ASSERT_EQ(utf8Validate(str), utf8ValidateScalar(str)) << "UTF-8 Validation Consistency Test Failed";
+        size_t chars = random() % 90;
+        size_t expectedOffset = str.size();
+        for (size_t pos = 0, count = 0; pos < str.size(); ++pos) {
+            if ((static_cast<unsigned char>(str[pos]) & 0xC0u) != 0x80u && count++ == chars) {
+                expectedOffset = pos;
+                break;
+            }
+        }
+        ASSERT_EQ(utf8CharsToBytes(str, chars), expectedOffset) << "UTF-8 Char Offset Consistency Test Failed";
+    }
+}
+
+TEST(CLyricTests, DISABLED_CLyricUtf8Benchmark) {
+    std::string text;
+    while (text.size() < (1u << 20))
+        text += "原谅我这一生不羁放纵爱自由 也会怕有一天会跌倒 Oh no\n";
+
+    auto measure = [&text](const char *name, auto function) {
+        size_t result = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 200; ++i)
+            result += function(std::string_view(text));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-22s %8.2f GB/s (%zu)\n", name, 200.0 * text.size() / seconds / 1e9, result);
+    };
+    measure("utf8StringCharsScalar", utf8StringCharsScalar);
+    measure("utf8StringChars", utf8StringChars);
+    measure("utf8ValidateScalar", utf8ValidateScalar);
+    measure("utf8Validate", utf8Validate);
+}
+
+namespace {
+
+    // The matrix DP implementations the bit-parallel ones have to agree with
+    int matrixLevenshtein(const std::string &str1, const std::string &str2) {
+        size_t column = str2.size() + 1;
+        std::vector<int> distance((str1.size() + 1) * column);
+        for (size_t j = 0; j < column; ++j)
+            distance[j] = static_cast<int>(j);
+        for (size_t i = 1; i <= str1.size(); ++i) {
+            distance[i * column] = static_cast<int>(i);
+            for (size_t j = 1; j < column; ++j) {
+                int cost = str1[i - 1] == str2[j - 1] ? 0 : 1;
+                distance[i * column + j] = std::min({distance[(i - 1) * column + j] + 1,
+                                                     distance[i * column + j - 1] + 1,
+                                                     distance[(i - 1) * column + j - 1] + cost});
+            }
+        }
+        return distance.back();
+    }
+
+    int matrixLCS(const std::string &str1, const std::string &str2) {
+        size_t column = str2.size() + 1;
+        std::vector<int> lcs((str1.size() + 1) * column);
+        for (size_t i = 1; i <= str1.size(); ++i) {
+            for (size_t j = 1; j < column; ++j) {
+                lcs[i * column + j] = str1[i - 1] == str2[j - 1] ? lcs[(i - 1) * column + j - 1] + 1
+                                                                 : std::max(lcs[(i - 1) * column + j],
+                                                                            lcs[i * column + j - 1]);
+            }
+        }
+        return lcs.back();
+    }
+
+}
+
+TEST(CLyricTests, CLyricStringDistanceTest) {
+    EXPECT_EQ(levenshteinDistance("kitten", "sitting"), 3) << "Levenshtein Distance Test Failed";
+    EXPECT_EQ(levenshteinDistance("", "abc"), 3) << "Levenshtein Empty String Test Failed";
+    EXPECT_EQ(longestCommonSubsequece("ABCBDAB", "BDCABA"), 4) << "LCS Test Failed";
+    EXPECT_EQ(longestCommonSubsequece("abc", ""), 0) << "LCS Empty String Test Failed";
+    EXPECT_EQ(stringDistance("光辉岁月", "光辉岁月"), 0) << "String Distance Equal Test Failed";
+
+    // Lengths around the 64 byte word boundaries and past the stack buffers
+    std::mt19937 random(7);
+    for (int i = 0; i < 3000; ++i) {
+        std::string str1, str2;
+        size_t alphabet = i % 3 ? 4 : 40;
+        size_t length1 = random() % (i % 10 ? 140 : 400), length2 = random() % (i % 10 ? 140 : 400);
+        for (size_t j = 0; j < length1; ++j)
+            str1 += static_cast<char>('a' + random() % alphabet);
+        for (size_t j = 0; j < length2; ++j)
+            str2 += static_cast<char>('a' + random() % alphabet);
+        ASSERT_EQ(levenshteinDistance(str1, str2), matrixLevenshtein(str1, str2))
+                                    << "Levenshtein Consistency Test Failed";
+        ASSERT_EQ(longestCommonSubsequece(str1, str2), matrixLCS(str1, str2)) << "LCS Consistency Test Failed";
+    }
+}
+
+TEST(CLyricTests, CLyricCodepointDistanceTest) {
+    EXPECT_GT(levenshteinDistance("光辉岁月", "光輝歲月"), 2) << "Byte Distance Test Failed";
+    EXPECT_EQ(codepointDistance("光辉岁月", "光輝歲月"), 2) << "Code Point Distance Test Failed";
+    EXPECT_EQ(codepointDistance("光辉岁月", "光輝歲月", 1), 2) << "Code Point Distance Bound Test Failed";
+    EXPECT_EQ(codepointDistance("Ｂｅｙｏｎｄ", "beyond", 0, true), 0) << "Code Point Distance Folding Test Failed";
+    EXPECT_EQ(codepointStringDistance("海阔天空 (Live)", "海阔天空"), 7) << "Code Point String Distance Test Failed";
+
+    MatchKey title("海阔天空"), artist("Beyond");
+    EXPECT_EQ(maxTrackDistance(title, artist), 7) << "Track Distance Bound Test Failed";
+    EXPECT_EQ(trackDistance(MatchKey("海阔天空"), MatchKey("BEYOND"), title, artist), 0) << "Track Distance Test Failed";
+    EXPECT_GT(trackDistance(MatchKey("Bohemian Rhapsody"), MatchKey("Queen"), title, artist),
+              maxTrackDistance(title, artist)) << "Track Distance Cutoff Test Failed";
+
+    // The bound has to agree with the exact distance within it and exceed the bound otherwise
+    std::mt19937 random(13);
+    std::vector<std::string> pieces = {"a", "b", "原", "谅", "我", "🎵"};
+    for (int i = 0; i < 3000; ++i) {
+        std::string str1, str2;
+        size_t length1 = random() % 30, length2 = random() % 30;
+        for (size_t j = 0; j < length1; ++j)
+            str1 += pieces[random() % pieces.size()];
+        for (size_t j = 0; j < length2; ++j)
+            str2 += pieces[random() % pieces.size()];
+        int distance = codepointDistance(str1, str2);
+        int maxDistance = static_cast<int>(random() % 20);
+        ASSERT_EQ(codepointDistance(str1, str2, maxDistance), std::min(distance, maxDistance + 1))
+                                    << "Code Point Distance Bound Consistency Test Failed";
+        if (str1.size() == length1 && str2.size() == length2) {
+            ASSERT_EQ(distance, levenshteinDistance(str1, str2)) << "Code Point Distance ASCII Test Failed";
+        }
+    }
+
+    // Every piece stands for one ASCII char, so the byte distances of those strings are the expected ones,
+    // with lengths around the 64 char word boundaries and past the stack buffers
+    for (int i = 0; i < 1000; ++i) {
+        std::string str1, str2, ascii1, ascii2;
+        size_t length1 = random() % 150, length2 = random() % 150;
+        for (size_t j = 0; j < length1; ++j) {
+            size_t piece = random() % pieces.size();
+            str1 += pieces[piece];
+            ascii1 += static_cast<char>('a' + piece);
+        }
+        for (size_t j = 0; j < length2; ++j) {
+            size_t piece = random() % pieces.size();
+            str2 += pieces[piece];
+            ascii2 += static_cast<char>('a' + piece);
+        }
+        ASSERT_EQ(codepointDistance(str1, str2), levenshteinDistance(ascii1, ascii2))
+                                    << "Code Point Distance Consistency Test Failed";
+        ASSERT_EQ(codepointStringDistance(str1, str2), stringDistance(ascii1, ascii2))
+                                    << "Code Point String Distance Consistency Test Failed";
+    }
+}
+
+TEST(CLyricTests, CLyricMatchKeyTest) {
+    EXPECT_EQ(MatchKey("光輝歲月"), MatchKey("光辉岁月")) << "Match Key Traditional Chars Test Failed";
+    EXPECT_EQ(MatchKey("ＬＯＶＥ　ｓｏｎｇ（Ｌｉｖｅ）"), MatchKey("love song(live)")) << "Match Key Fullwidth Test Failed";
+    EXPECT_EQ(MatchKey("Café"), MatchKey("CAFÉ")) << "Match Key Latin-1 Case Test Failed";
+    EXPECT_EQ(MatchKey("【MV】 夢"), MatchKey("[mv] 梦")) << "Match Key Punctuation Test Failed";
+    EXPECT_EQ(MatchKey("  Hello   World \t"), MatchKey("hello world")) << "Match Key Whitespace Test Failed";
+
+    EXPECT_EQ(MatchKey("Stay (feat. Justin Bieber)"), MatchKey("Stay")) << "Match Key Featuring Test Failed";
+    EXPECT_EQ(MatchKey("Song [ft. Someone] (Live)"), MatchKey("Song (Live)")) << "Match Key Featuring Test Failed";
+    EXPECT_EQ(MatchKey("Artist Feat. Other"), MatchKey("artist")) << "Match Key Featuring Test Failed";
+    EXPECT_EQ(MatchKey("Defeat"), MatchKey("defeat")) << "Match Key Featuring Word Test Failed";
+
+    EXPECT_EQ(matchDistance(MatchKey("光輝歲月 (Live)"), MatchKey("光辉岁月")), 7) << "Match Distance Test Failed";
+    EXPECT_EQ(MatchKey("光輝歲月").size(), 4) << "Match Key Size Test Failed";
+}
+
+TEST(CLyricTests, CLyricNormalizeNameTest) {
+    EXPECT_EQ(normalizeName("Don't Stop Me Now!"), "Don t Stop Me Now ") << "Normalize Name Test Failed";
+    EXPECT_EQ(normalizeName("海阔天空 Beyond", true), "%E6%B5%B7%E9%98%94%E5%A4%A9%E7%A9%BA%20Beyond")
+                        << "Normalize Name URL Escape Test Failed";
+    EXPECT_EQ(normalizeName("a-b.c_d~e", true, false), "a-b.c_d~e") << "Normalize Name Unreserved Test Failed";
+    EXPECT_EQ(normalizeName("a-b.c_d~e", true), "a%20b%20c%20d%20e") << "Normalize Name Special Chars Test Failed";
+    EXPECT_EQ(normalizeFileName("AC/DC: Back in Black?.clrc"), "AC DC  Back in Black .clrc")
+                        << "Normalize File Name Test Failed";
+
+    // Compare against the per-byte switch and curl_easy_escape rules over runs longer than a vector
+    auto reference = [](std::string str, bool urlEscape, bool noSpecialChars, const std::string &special) {
+        for (char &ch: str) {
+            if (noSpecialChars && special.find(ch) != std::string::npos)
+                ch = ' ';
+        }
+        if (!urlEscape)
+            return str;
+        std::string escaped;
+        for (char ch: str) {
+            if (std::isalnum(static_cast<unsigned char>(ch)) || std::string("-._~").find(ch) != std::string::npos) {
+                escaped += ch;
+            } else {
+                char hex[4];
+                std::snprintf(hex, sizeof(hex), "%%%02X", static_cast<unsigned char>(ch));
+                escaped += hex;
+            }
+        }
+        return escaped;
+    };
+    std::string punctuation = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+    std::mt19937 random(16);
+    std::vector<std::string> pieces = {"abc", "XYZ", "09", " ", "原", "\t", "\x7F", "-", "/", ":", "?", "'", "~"};
+    for (int i = 0; i < 2000; ++i) {
+        std::string str;
+        size_t pieceCount = random() % 40;
+        for (size_t j = 0; j < pieceCount; ++j)
+            str += pieces[random() % (i % 2 ? pieces.size() : 6)];
+        ASSERT_EQ(normalizeName(str, i % 3 == 0, i % 4 != 0), reference(str, i % 3 == 0, i % 4 != 0, punctuation))
+                                    << "Normalize Name Consistency Test Failed";
+        ASSERT_EQ(normalizeFileName(str), reference(str, false, true, "/\\?%*:|\"<>"))
+                                    << "Normalize File Name Consistency Test Failed";
+    }
+}
+
+TEST(CLyricTests, DISABLED_CLyricStringDistanceBenchmark) {
+    std::vector<std::pair<std::string, std::string>> pairs = {
+            {"光辉岁月",                                     "光輝歲月 (Live)"},
+            {"Bohemian Rhapsody",                        "Bohemian Rhapsody - Remastered 2011"},
+            {"原谅我这一生不羁放纵爱自由",                         "海阔天空 (国语版)"},
+            {"Tuesday Afternoon (Forever Afternoon)", "Nights in White Satin (Single Version) [Remastered]"},
+    };
+
+    auto measure = [&pairs](const char *name, auto function) {
+        long long result = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 200000; ++i) {
+            const auto &pair = pairs[i % pairs.size()];
+            result += function(pair.first, pair.second);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-20s %8.1f ns/pair (%lld)\n", name, seconds * 1e9 / 200000, result);
+    };
+    measure("matrixLevenshtein", matrixLevenshtein);
+    measure("levenshteinDistance", levenshteinDistance);
+    measure("matrixLCS", matrixLCS);
+    measure("longestCommonSubsequece", longestCommonSubsequece);
+    measure("codepointStringDistance", [](const std::string &str1, const std::string &str2) {
+        return codepointStringDistance(str1, str2);
+    });
+}
+
+namespace {
+
+    // The iostream based serializer the buffer based one has to match byte for byte
+    std::string streamReadableString(const CLyric &lyric) {
+        std::ostringstream stringStream;
+        stringStream << "[ti]" << lyric.track.title << '\n';
+        if (!lyric.track.album.empty())
+            stringStream << "[al]" << lyric.track.album << '\n';
+        if (!lyric.track.artist.empty())
+            stringStream << "[ar]" << lyric.track.artist << '\n';
+        if (lyric.track.duration > 0)
+            stringStream << "[du]" << lyric.track.duration << '\n';
+        if (lyric.offset != 0)
+            stringStream << "[offset]" << ((lyric.offset > 0) ? "+" : "") << lyric.offset << '\n';
+        if (lyric.track.instrumental) {
+            stringStream << "[instrumental]\n";
+            return stringStream.str();
+        }
+        for (const CLyricItem &item: lyric.lyrics) {
+            std::ostringstream timeTagStream;
+            timeTagStream << '[' << std::setw(2) << std::setfill('0') << item.startTime / 60000 << ':'
+                          << std::setw(2) << std::setfill('0') << item.startTime / 1000 % 60 << '.' << std::left
+                          << std::setw(3) << std::setfill('0') << item.startTime % 1000 << ']';
+            std::string timeTag = timeTagStream.str();
+            stringStream << timeTag << item.content << '\n';
+            if (!item.translation.empty())
+                stringStream << timeTag << "[tr]" << item.translation << '\n';
+            if (!item.timecodes.empty()) {
+                stringStream << timeTag << "[tc]";
+                for (size_t i = 0; i < item.timecodes.size(); ++i)
+                    stringStream << (i > 0 ? "|" : "") << item.timecodes[i].first << ',' << item.timecodes[i].second;
+                stringStream << '\n';
+            }
+        }
+        return stringStream.str();
+    }
+
+    CLyric randomLyric(std::mt19937 &random, size_t itemCount) {
+        std::vector<CLyricItem> items;
+        for (size_t i = 0; i < itemCount; ++i) {
+            int startTime = static_cast<int>(random() % 7200000) - (i == 0 ? 5000 : 0);
+            std::vector<std::pair<int, int>> timecodes;
+            for (size_t j = random() % 3 == 0 ? random() % 12 : 0; j > 0; --j)
+                timecodes.emplace_back(static_cast<int>(random() % 5000), static_cast<int>(random() % 30));
+            items.emplace_back("原谅我这一生不羁放纵爱自由 " + std::to_string(i), startTime,
+                               random() % 2 ? "翻译" : "", timecodes);
+        }
+        CLyric lyric(Track("海阔天空", random() % 2 ? "乐与怒" : "", "Beyond", "", "", static_cast<int>(random() % 400)),
+                     std::move(items));
+        lyric.offset = static_cast<int>(random() % 2001) - 1000;
+        return lyric;
+    }
+
+}
+
+TEST(CLyricTests, CLyricSerializerTest) {
+    std::mt19937 random(7);
+    for (int i = 0; i < 200; ++i) {
+        CLyric lyric = randomLyric(random, random() % 40);
+        lyric.track.instrumental = i % 50 == 0;
+        ASSERT_EQ(lyric.readableString(), streamReadableString(lyric)) << "Lyric Serializer Test Failed";
+    }
+}
+
+TEST(CLyricTests, DISABLED_CLyricSerializerBenchmark) {
+    std::mt19937 random(7);
+    std::vector<CLyric> library;
+    for (int i = 0; i < 2000; ++i)
+        library.push_back(randomLyric(random, 60));
+
+    auto measure = [](const char *name, auto function) {
+        auto start = std::chrono::steady_clock::now();
+        size_t size = function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-28s %8.3f s (%zu bytes)\n", name, seconds, size);
+    };
+    measure("Stream serializer", [&library]() {
+        size_t size = 0;
+        for (const CLyric &lyric: library)
+            size += streamReadableString(lyric).size();
+        return size;
+    });
+    measure("Buffer serializer", [&library]() {
+        size_t size = 0;
+        for (const CLyric &lyric: library)
+            size += lyric.readableString().size();
+        return size;
+    });
+
+    // Dragging the offset slider saves the current lyric on every change
+    auto directory = std::filesystem::temp_directory_path() / "CLyricSerializerBenchmark";
+    std::filesystem::create_directories(directory);
+    CLyric &lyric = library.front();
+    measure("Offset save loop (1000 saves)", [&lyric, &directory]() {
+        for (int offset = 0; offset < 1000; ++offset) {
+            lyric.offset = offset;
+            lyric.saveToFile(directory.u8string());
+        }
+        return lyric.readableString().size();
+    });
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricLazyTimecodesTest) {
+    std::string contentText = R"([ti]Lazy
+[00:01.000]Content
+[00:01.000][tc]0,0| 500,3|bad|1000,7
+[00:02.000]Next
+)";
+
+    CLyric lyric(contentText, LyricStyle::CLrcStyle);
+    const CLyricTimecodes &timecodes = lyric.lyrics[0].timecodes;
+    EXPECT_EQ(timecodes.rawPayload(), "0,0| 500,3|bad|1000,7") << "Lazy Timecodes Raw Payload Test Failed";
+    EXPECT_FALSE(timecodes.empty()) << "Lazy Timecodes Empty Test Failed";
+    EXPECT_TRUE(lyric.lyrics[1].timecodes.empty()) << "Lazy Timecodes Empty Test Failed";
+
+    // Saved back unchanged, malformed pairs included
+    EXPECT_EQ(lyric.readableString(), contentText) << "Lazy Timecodes Save Test Failed";
+
+    std::vector<std::pair<int, int>> expected{{0, 0}, {500, 3}, {1000, 7}};
+    EXPECT_EQ(timecodes, expected) << "Lazy Timecodes Decode Test Failed";
+    EXPECT_EQ(timecodes.size(), 3) << "Lazy Timecodes Size Test Failed";
+
+    lyric.lyrics[0].timecodes.emplace_back(1500, 9);
+    EXPECT_TRUE(lyric.lyrics[0].timecodes.rawPayload().empty()) << "Lazy Timecodes Edit Test Failed";
+    EXPECT_NE(lyric.readableString().find("[00:01.000][tc]0,0|500,3|1000,7|1500,9\n"), std::string::npos)
+                        << "Lazy Timecodes Edited Save Test Failed";
+
+    // A payload without a single well-formed pair is no timecodes at all, and is not saved back
+    CLyric junkLyric("[ti]Junk\n[00:01.000]Content\n[00:01.000][tc]bad|,|junk\n", LyricStyle::CLrcStyle);
+    EXPECT_TRUE(junkLyric.lyrics[0].timecodes.empty()) << "Lazy Timecodes Junk Empty Test Failed";
+    EXPECT_EQ(junkLyric.readableString().find("[tc]"), std::string::npos) << "Lazy Timecodes Junk Save Test Failed";
+}
+
+TEST(CLyricTests, CLyricTimelineSeekTest) {
+    CLyric lyric(Track("Timeline"), {CLyricItem("First", 1000), CLyricItem("Second", 3000),
+                                     CLyricItem("Third", 3000), CLyricItem("Last", 7000)});
+    CLyricTimeline timeline(lyric);
+
+    auto seek = [&timeline](int position) {
+        CLyricTimeline::Position result = timeline.seek(position);
+        return std::vector<int>{result.line, result.timeInLine, result.nextEventIn};
+    };
+    EXPECT_EQ(seek(0), std::vector<int>({0, -1000, 3000})) << "Timeline Before First Line Test Failed";
+    EXPECT_EQ(seek(1000), std::vector<int>({0, 0, 2000})) << "Timeline Line Start Test Failed";
+    EXPECT_EQ(seek(3500), std::vector<int>({2, 500, 3500})) << "Timeline Equal Start Times Test Failed";
+    EXPECT_EQ(seek(7000), std::vector<int>({3, 0, -1})) << "Timeline Last Line Test Failed";
+    EXPECT_EQ(seek(100000), std::vector<int>({3, 93000, -1})) << "Timeline After Last Line Test Failed";
+
+    timeline.setOffset(-500);
+    EXPECT_EQ(seek(6600), std::vector<int>({3, 100, -1})) << "Timeline Offset Test Failed";
+    EXPECT_EQ(timeline.startTime(1), 2500) << "Timeline Offset Start Time Test Failed";
+
+    EXPECT_EQ(CLyricTimeline().seek(1000).nextEventIn, -1) << "Empty Timeline Test Failed";
+}
+
+TEST(CLyricTests, CLyricKaraokeCursorTest) {
+    // Kugou style timecodes: (ms, chars sung so far), the last one ends the line
+    CLyricTimecodes timecodes(std::vector<std::pair<int, int>>{{0, 0}, {200, 1}, {600, 3}, {1000, 4}});
+    std::vector<double> charPositions{0, 10, 20, 30, 40, 50};
+    CLyricKaraokeCursor cursor(timecodes, charPositions);
+
+    EXPECT_EQ(cursor.endTime(), 1000) << "Karaoke Cursor End Time Test Failed";
+    EXPECT_EQ(cursor.segment(-100), 0) << "Karaoke Cursor Segment Test Failed";
+    EXPECT_EQ(cursor.segment(200), 1) << "Karaoke Cursor Segment Test Failed";
+    EXPECT_EQ(cursor.segment(999), 2) << "Karaoke Cursor Segment Test Failed";
+    EXPECT_DOUBLE_EQ(cursor.position(-100), 0) << "Karaoke Cursor Before Start Test Failed";
+    EXPECT_DOUBLE_EQ(cursor.position(100), 5) << "Karaoke Cursor Interpolation Test Failed";
+    EXPECT_DOUBLE_EQ(cursor.position(400), 20) << "Karaoke Cursor Interpolation Test Failed";
+    EXPECT_DOUBLE_EQ(cursor.position(800), 40) << "Karaoke Cursor Line End Test Failed";
+    EXPECT_DOUBLE_EQ(cursor.position(5000), 50) << "Karaoke Cursor After End Test Failed";
+
+    CLyricKaraokeCursor single(CLyricTimecodes(std::vector<std::pair<int, int>>{{300, 2}}), charPositions);
+    EXPECT_DOUBLE_EQ(single.position(0), 50) << "Karaoke Cursor Single Timecode Test Failed";
+    EXPECT_TRUE(CLyricKaraokeCursor(CLyricTimecodes(), charPositions).empty()) << "Karaoke Cursor Empty Test Failed";
+
+    std::vector<size_t> measured;
+    CLyricKaraokeCursor measuring(timecodes, 5, [&measured](size_t chars) {
+        measured.push_back(chars);
+        return 10.0 * double(chars);
+    });
+    EXPECT_EQ(measured, std::vector<size_t>({0, 1, 3, 5})) << "Karaoke Cursor Measured Chars Test Failed";
+    EXPECT_DOUBLE_EQ(measuring.position(400), cursor.position(400)) << "Karaoke Cursor Measuring Test Failed";
+}
+
+TEST(CLyricTests, CLyricRankerTest) {
+    std::vector<CLyric> lyrics;
+    lyrics.emplace_back(Track("海阔天空", "", "Beyond", "", "Plain", 326), std::vector<CLyricItem>{
+            CLyricItem("今天我", 1000)});
+    lyrics.emplace_back(Track("Bohemian Rhapsody", "", "Queen", "", "Unrelated", 355), std::vector<CLyricItem>{
+            CLyricItem("Is this the real life", 1000, "这是真实的人生吗")});
+    lyrics.emplace_back(Track("海阔天空", "", "Beyond", "", "Translated", 330), std::vector<CLyricItem>{
+            CLyricItem("今天我", 1000, "Today I")});
+    lyrics.emplace_back(Track("海阔天空", "", "Beyond", "", "Invalid", 326), std::vector<CLyricItem>());
+    lyrics.emplace_back(Track("海阔天空", "", "BEYOND", "", "Closer", 325), std::vector<CLyricItem>{
+            CLyricItem("今天我", 1000)});
+
+    CLyricRanker ranker("海阔天空", "Beyond", 325);
+    CLyricScore score = ranker.score(lyrics[2]);
+    EXPECT_EQ(score.distance, 0) << "Ranker Distance Test Failed";
+    EXPECT_TRUE(score.hasTranslation && !score.hasTimecodes && score.valid) << "Ranker Flags Test Failed";
+    EXPECT_EQ(score.durationDelta, 5) << "Ranker Duration Test Failed";
+    EXPECT_DOUBLE_EQ(score.score, 1.2) << "Ranker Score Test Failed";
+
+    ranker.rank(lyrics);
+    std::vector<std::string> sources;
+    for (const CLyric &lyric: lyrics)
+        sources.push_back(lyric.track.source);
+    std::vector<std::string> expected{"Translated", "Closer", "Plain", "Invalid", "Unrelated"};
+    EXPECT_EQ(sources, expected) << "Ranker Order Test Failed";
+
+    CLyricScore metadataScore = ranker.score(Track("海阔天空", "", "Beyond", "", "", 330));
+    EXPECT_TRUE(metadataScore.valid && metadataScore.durationDelta == 5) << "Ranker Metadata Test Failed";
+    EXPECT_TRUE(CLyricRanker::better(metadataScore, ranker.score(Track("海阔天空", "", "Beyond", "", "", 200))))
+                        << "Ranker Metadata Test Failed";
+    EXPECT_TRUE(CLyricRanker::better(ranker.score(Track("海阔天空", "", "Beyond")),
+                                     ranker.score(Track("海阔", "", "Beyond")))) << "Ranker Metadata Test Failed";
+
+    EXPECT_TRUE(ranker.durationMatches(Track("海阔天空", "", "Beyond", "", "", 335), 10)) << "Ranker Duration Test Failed";
+    EXPECT_FALSE(ranker.durationMatches(Track("海阔天空", "", "Beyond", "", "", 400), 10))
+                        << "Ranker Duration Test Failed";
+    EXPECT_TRUE(ranker.durationMatches(Track("海阔天空", "", "Beyond"), 10)) << "Ranker Duration Test Failed";
+
+    CLyricSearchStats stats;
+    stats.durationMismatches = 3;
+    stats.lyricRequests = 2;
+    stats.lyricBytes = 5000;
+    EXPECT_EQ(stats.savedRequests(), 3) << "Search Stats Test Failed";
+    EXPECT_EQ(stats.savedBytes(), 7500) << "Search Stats Test Failed";
+}
+
+namespace {
+
+    // Exposes the batch downloader, file:// URLs stand in for the provider APIs
+    class BatchTestProvider : public CLyricProvider {
+    public:
+        using CLyricProvider::downloadBatch;
+        using CLyricProvider::candidate;
+        using CLyricProvider::selectCandidates;
+
+        [[nodiscard]] const char *name() const override { return "BatchTest"; }
+
+        std::vector<CLyricCandidate> searchCandidates(const Track &) override { return {}; }
+
+        std::vector<CLyric> downloadLyrics(const Track &, const std::vector<CLyricCandidate> &) override { return {}; }
+    };
+
+}
+
+TEST(CLyricTests, CLyricProviderBatchTest) {
+    auto directory = std::filesystem::temp_directory_path() / "CLyricProviderBatchTest";
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> urls;
+    for (int i = 0; i < 5; ++i) {
+        auto path = directory / ("lyric" + std::to_string(i) + ".lrc");
+        if (i != 1) { // The second download fails
+            std::ofstream file(path);
+            file << "[00:01.00]Line " << i << "\n[00:02.00]" << (i == 2 ? "" : "Second line") << '\n';
+        }
+        std::string genericPath = path.generic_string();
+        urls.push_back((genericPath.front() == '/' ? "file://" : "file:///") + genericPath);
+    }
+
+    BatchTestProvider provider;
+    std::vector<size_t> completed;
+    std::vector<std::string> bodies(urls.size());
+    provider.downloadBatch(urls, 3, [&](size_t index, std::string &body) {
+        completed.push_back(index);
+        bodies[index] = body;
+        return index != 2; // Yields no result, so the next url is started
+    });
+    std::sort(completed.begin(), completed.end());
+    EXPECT_EQ(completed, std::vector<size_t>({0, 2, 3, 4})) << "Provider Batch Refill Test Failed";
+    EXPECT_EQ(bodies[3], "[00:01.00]Line 3\n[00:02.00]Second line\n") << "Provider Batch Body Test Failed";
+    EXPECT_EQ(provider.transferCount(), 5) << "Provider Batch Stats Test Failed";
+    EXPECT_EQ(provider.transferBytes(), bodies[0].size() + bodies[2].size() + bodies[3].size() + bodies[4].size())
+                        << "Provider Batch Stats Test Failed";
+
+    std::vector<CLyricStreamParser> parsers(urls.size());
+    size_t results = 0;
+    provider.downloadBatch(urls, 1, [&](size_t index, std::string &body) {
+        EXPECT_TRUE(body.empty()) << "Provider Batch Parser Test Failed";
+        results += parsers[index].finish().lyrics.size();
+        return true;
+    }, &parsers);
+    EXPECT_EQ(results, 2) << "Provider Batch Parser Test Failed";
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricCandidateTest) {
+    MatchKey title("Bohemian Rhapsody"), artist("Queen");
+    std::vector<CLyricCandidate> candidates;
+    candidates.push_back(BatchTestProvider::candidate(Track("Bohemian Rhapsody (Live)", "", "Queen"), "1", title,
+                                                      artist));
+    candidates.push_back(BatchTestProvider::candidate(Track("Another One Bites the Dust", "", "Queen"), "2", title,
+                                                      artist));
+    for (int i = 0; i < 5; ++i) // Only the farthest match is left out
+        candidates.push_back(BatchTestProvider::candidate(Track("bohemian rhapsody", "", "QUEEN"), "3", title, artist));
+    EXPECT_EQ(candidates[2].distance, 0) << "Candidate Distance Test Failed";
+
+    BatchTestProvider::selectCandidates(candidates, title, artist);
+    ASSERT_EQ(candidates.size(), CLyricProvider::maxCandidates) << "Candidate Selection Test Failed";
+    EXPECT_EQ(candidates.back().lyricUrl, "1") << "Candidate Selection Test Failed";
+}
+
+TEST(CLyricTests, CLyricConnectionPoolTest) {
+    CLyricConnectionPool &pool = CLyricConnectionPool::instance();
+    EXPECT_EQ(&pool, &CLyricConnectionPool::instance()) << "Connection Pool Instance Test Failed";
+
+    CURL *handle = pool.acquire();
+    ASSERT_NE(handle, nullptr) << "Connection Pool Acquire Test Failed";
+    curl_easy_setopt(handle, CURLOPT_REFERER, "http://example.com/");
+    pool.release(handle);
+    EXPECT_EQ(pool.acquire(), handle) << "Connection Pool Reuse Test Failed";
+
+    CURL *otherHandle = pool.acquire();
+    EXPECT_NE(otherHandle, handle) << "Connection Pool Borrow Test Failed";
+    CURL *copy = pool.duplicate(handle);
+    ASSERT_NE(copy, nullptr) << "Connection Pool Duplicate Test Failed";
+    curl_easy_cleanup(copy);
+    pool.release(otherHandle);
+    pool.release(handle);
+}
+
+TEST(CLyricTests, CLyricCancellationTest) {
+    CLyricCancellation token;
+    CLyricCancellation copy = token;
+    EXPECT_FALSE(copy.shouldStop()) << "Cancellation Initial State Test Failed";
+    token.cancel();
+    EXPECT_TRUE(copy.isCancelled()) << "Cancellation Shared State Test Failed";
+    EXPECT_FALSE(copy.isExpired()) << "Cancellation Shared State Test Failed";
+
+    CLyricCancellation expired(std::chrono::milliseconds(0));
+    EXPECT_TRUE(expired.isExpired() && !expired.isCancelled()) << "Cancellation Deadline Test Failed";
+    EXPECT_FALSE(CLyricCancellation(std::chrono::hours(1)).shouldStop()) << "Cancellation Deadline Test Failed";
+
+    auto path = std::filesystem::temp_directory_path() / "CLyricCancellationTest.lrc";
+    std::ofstream(path) << "[00:01.00]Line\n";
+    std::string genericPath = path.generic_string();
+    std::vector<std::string> urls(3, (genericPath.front() == '/' ? "file://" : "file:///") + genericPath);
+
+    BatchTestProvider provider;
+    size_t completed = 0;
+    auto countCompleted = [&completed](size_t, std::string &) {
+        ++completed;
+        return true;
+    };
+    provider.setCancellation(expired);
+    provider.downloadBatch(urls, urls.size(), countCompleted);
+    EXPECT_EQ(completed, 0) << "Cancellation Batch Test Failed";
+    provider.setCancellation(CLyricCancellation());
+    provider.downloadBatch(urls, urls.size(), countCompleted);
+    EXPECT_EQ(completed, urls.size()) << "Cancellation Batch Test Failed";
+    std::filesystem::remove(path);
+
+    auto directory = (std::filesystem::temp_directory_path() / "CLyricCancellationTest").u8string();
+    EXPECT_FALSE(CLyricSearch(token).fetchCLyric("Title", "Album", "Artist", 180, directory).isValid())
+                        << "Cancellation Search Test Failed";
+}
+
+TEST(CLyricTests, CLyricResponseCacheTest) {
+    EXPECT_EQ(CLyricResponseCache::normalizeUrl("HTTP://Music.163.com:80/api/search?s=a&offset=0&limit=10#top"),
+              "http://music.163.com/api/search?limit=10&offset=0&s=a") << "Response Cache URL Test Failed";
+    EXPECT_EQ(CLyricResponseCache::normalizeUrl("https://example.com:443?b=2&a=1&b=1&"),
+              "https://example.com/?a=1&b=2&b=1") << "Response Cache URL Test Failed";
+
+    std::string text, compressed, inflated;
+    for (int i = 0; i < 200; ++i)
+        text += "[00:0" + std::to_string(i % 10) + ".00]Line\n";
+    ASSERT_TRUE(zlibDeflate(text, compressed)) << "Deflate Test Failed";
+    EXPECT_LT(compressed.size(), text.size()) << "Deflate Test Failed";
+    EXPECT_TRUE(zlibInflate(compressed, inflated) && inflated == text) << "Deflate Test Failed";
+
+    auto directory = std::filesystem::temp_directory_path() / "CLyricResponseCacheTest";
+    std::filesystem::remove_all(directory);
+    {
+        CLyricResponseCache cache;
+        std::string body;
+        cache.store("http://example.com/lyric?id=1", "", CLyricResponseCache::Kind::Content, text);
+        EXPECT_FALSE(cache.load("http://example.com/lyric?id=1", "", body)) << "Response Cache Closed Test Failed";
+
+        ASSERT_TRUE(cache.open(directory.u8string())) << "Response Cache Open Test Failed";
+        cache.store("http://example.com/lyric?id=1", "", CLyricResponseCache::Kind::Content, text);
+        EXPECT_TRUE(cache.load("http://EXAMPLE.com/lyric?id=1#x", "", body) && body == text)
+                            << "Response Cache Load Test Failed";
+        EXPECT_FALSE(cache.load("http://example.com/lyric?id=1", "key=1", body)) << "Response Cache Key Test Failed";
+        EXPECT_LT(cache.size(), text.size()) << "Response Cache Compression Test Failed";
+
+        cache.setTimeToLive(CLyricResponseCache::Kind::Search, std::chrono::seconds(0));
+        cache.store("http://example.com/search?s=a", "", CLyricResponseCache::Kind::Search, "[]");
+        EXPECT_FALSE(cache.load("http://example.com/search?s=a", "", body)) << "Response Cache Expiry Test Failed";
+    }
+    {
+        CLyricResponseCache cache;
+        std::string body;
+        auto staleFile = directory / "stale.resp.0.tmp";
+        std::ofstream(staleFile) << "partial";
+        ASSERT_TRUE(cache.open(directory.u8string(), 2048)) << "Response Cache Reopen Test Failed";
+        EXPECT_FALSE(std::filesystem::exists(staleFile)) << "Response Cache Temporary File Test Failed";
+        EXPECT_TRUE(cache.load("http://example.com/lyric?id=1", "", body) && body == text)
+                            << "Response Cache Persistence Test Failed";
+
+        // Incompressible bodies, so every store pushes the least recently used entry out
+        std::mt19937 random(42);
+        std::string noise(700, '\0');
+        for (int i = 2; i < 6; ++i) {
+            for (char &ch: noise)
+                ch = static_cast<char>(random());
+            cache.store("http://example.com/lyric?id=" + std::to_string(i), "", CLyricResponseCache::Kind::Content,
+                        noise);
+            EXPECT_LE(cache.size(), 2048) << "Response Cache Budget Test Failed";
+        }
+        EXPECT_FALSE(cache.load("http://example.com/lyric?id=1", "", body)) << "Response Cache Eviction Test Failed";
+        EXPECT_TRUE(cache.load("http://example.com/lyric?id=5", "", body) && body == noise)
+                            << "Response Cache Eviction Test Failed";
+        cache.clear();
+        EXPECT_EQ(cache.size(), 0) << "Response Cache Clear Test Failed";
+    }
+    {
+        // The providers of a search store and load side by side, some of them the same request
+        CLyricResponseCache cache;
+        ASSERT_TRUE(cache.open(directory.u8string())) << "Response Cache Reopen Test Failed";
+        std::atomic<int> mismatches = 0;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 6; ++i) {
+            threads.emplace_back([&cache, &text, &mismatches, i] {
+                std::string body, url = "http://example.com/lyric?id=" + std::to_string(i % 3);
+                for (int round = 0; round < 50; ++round) {
+                    cache.store(url, "", CLyricResponseCache::Kind::Content, text);
+                    if (!cache.load(url, "", body) || body != text)
+                        ++mismatches;
+                }
+            });
+        }
+        for (std::thread &thread: threads)
+            thread.join();
+        EXPECT_EQ(mismatches, 0) << "Response Cache Concurrency Test Failed";
+        cache.clear();
+        EXPECT_EQ(cache.size(), 0) << "Response Cache Concurrency Test Failed";
+    }
+
+    // Downloads of a batch are served from the shared cache the second time
+    auto path = directory / "lyric.lrc";
+    std::ofstream(path) << "[00:01.00]Line\n";
+    std::string genericPath = path.generic_string();
+    std::vector<std::string> urls{(genericPath.front() == '/' ? "file://" : "file:///") + genericPath};
+    ASSERT_TRUE(CLyricResponseCache::instance().open((directory / "shared").u8string()))
+                                << "Response Cache Open Test Failed";
+    BatchTestProvider provider;
+    std::vector<std::string> bodies;
+    for (int i = 0; i < 2; ++i) {
+        std::vector<CLyricStreamParser> parsers(urls.size());
+        provider.downloadBatch(urls, 1, [&](size_t index, std::string &) {
+            bodies.push_back(parsers[index].finish().lyrics.at(0).content);
+            return true;
+        }, &parsers);
+    }
+    EXPECT_EQ(provider.transferCount(), 1) << "Response Cache Batch Test Failed";
+    EXPECT_EQ(bodies, std::vector<std::string>(2, "Line")) << "Response Cache Batch Test Failed";
+    CLyricResponseCache::instance().close();
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricNegativeCacheTest) {
+    auto directory = std::filesystem::temp_directory_path() / "CLyricNegativeCacheTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    EXPECT_EQ(utf8Encode(utf8Decode("Ünknown 光輝歲月 🎵")), "Ünknown 光輝歲月 🎵") << "UTF-8 Encode Test Failed";
+
+    Track track("Unknown Track", "Doujin Album", "Circle", "", "", 241);
+    EXPECT_EQ(CLyricNegativeCache::key(track), CLyricNegativeCache::key(Track("unknown  track", "doujin album",
+                                                                              "CIRCLE", "", "", 248)))
+                        << "Negative Cache Key Test Failed";
+    EXPECT_NE(CLyricNegativeCache::key(track), CLyricNegativeCache::key(Track("Unknown Track", "Doujin Album",
+                                                                              "Circle", "", "", 300)))
+                        << "Negative Cache Key Test Failed";
+
+    CLyricNegativeCache cache(directory.u8string());
+    EXPECT_FALSE(cache.shouldSkip(track)) << "Negative Cache Empty Test Failed";
+    cache.recordMiss(track);
+    int64_t first = cache.secondsToNextCheck(track);
+    EXPECT_TRUE(CLyricNegativeCache(directory.u8string()).shouldSkip(track)) << "Negative Cache Persistence Test Failed";
+    EXPECT_NEAR(first, 3600, 5) << "Negative Cache Interval Test Failed";
+    cache.recordMiss(track);
+    EXPECT_NEAR(cache.secondsToNextCheck(track), 7200, 5) << "Negative Cache Backoff Test Failed";
+    for (int i = 0; i < 40; ++i)
+        cache.recordMiss(track);
+    EXPECT_NEAR(cache.secondsToNextCheck(track), 30 * 24 * 3600, 5) << "Negative Cache Backoff Test Failed";
+
+    cache.remove(track);
+    EXPECT_FALSE(cache.shouldSkip(track)) << "Negative Cache Remove Test Failed";
+
+    // Entries overdue by more than the longest interval are dropped on the next write
+    std::ofstream(directory / "NoLyrics.cache") << "old\ttrack\t\t-1\t1\t1000\n";
+    cache.recordMiss(track);
+    cache.remove(track);
+    EXPECT_EQ(std::filesystem::file_size(directory / "NoLyrics.cache"), 0) << "Negative Cache Prune Test Failed";
+
+    // fetchCLyric returns right away for a track which missed recently
+    cache.recordMiss(track);
+    auto startTime = std::chrono::steady_clock::now();
+    EXPECT_FALSE(CLyricSearch().fetchCLyric(track.title, track.album, track.artist, track.duration,
+                                            directory.u8string()).isValid()) << "Negative Cache Search Test Failed";
+    EXPECT_LT(std::chrono::steady_clock::now() - startTime, std::chrono::seconds(1))
+                        << "Negative Cache Search Test Failed";
+
+    // A search no provider answered tells nothing about the track, here every circuit is open
+    cache.remove(track);
+    CLyricProviderHealth &health = CLyricProviderHealth::instance();
+    health.open((directory / "ProviderHealth.stats").u8string());
+    for (const char *name: {"Xiami", "Netease", "QQMusic", "Kugou", "Gecimi", "THBWiki"}) {
+        for (int i = 0; i < CLyricProviderHealth::failureThreshold; ++i)
+            health.recordResult(name, false, std::chrono::milliseconds(10000));
+    }
+    CLyricSearch search;
+    EXPECT_FALSE(search.fetchCLyric(track.title, track.album, track.artist, track.duration,
+                                    directory.u8string()).isValid()) << "Negative Cache Failed Search Test Failed";
+    EXPECT_EQ(search.statistics().answers, 0) << "Negative Cache Failed Search Test Failed";
+    EXPECT_FALSE(cache.shouldSkip(track)) << "Negative Cache Failed Search Test Failed";
+    health.open("");
+    std::filesystem::remove_all(directory);
+}
+
+TEST(CLyricTests, CLyricProviderHealthTest) {
+    CLyricProviderHealth health;
+    EXPECT_EQ(health.timeout("Netease"), CLyricProviderHealth::maxTimeout) << "Provider Health Default Test Failed";
+    EXPECT_DOUBLE_EQ(health.score("Netease"), 0.5) << "Provider Health Default Test Failed";
+
+    for (int latency: {100, 200, 300, 400, 500, 600, 700, 800, 900, 1000})
+        health.recordResult("Netease", true, std::chrono::milliseconds(latency));
+    health.recordChosen("Netease");
+    CLyricProviderStats stats = health.statistics("Netease");
+    EXPECT_EQ(stats.latencyPercentile(50), 500) << "Provider Health Percentile Test Failed";
+    EXPECT_EQ(stats.latencyPercentile(90), 900) << "Provider Health Percentile Test Failed";
+    EXPECT_EQ(health.timeout("Netease"), std::chrono::milliseconds(2700)) << "Provider Health Timeout Test Failed";
+    EXPECT_GT(health.score("Netease"), health.score("Kugou")) << "Provider Health Score Test Failed";
+
+    // The circuit opens after failureThreshold failures in a row
+    for (int i = 0; i < CLyricProviderHealth::failureThreshold; ++i) {
+        EXPECT_TRUE(health.allowRequest("Xiami")) << "Provider Health Circuit Test Failed";
+        health.recordResult("Xiami", false, std::chrono::milliseconds(10000));
+    }
+    EXPECT_FALSE(health.allowRequest("Xiami")) << "Provider Health Circuit Test Failed";
+    EXPECT_LT(health.score("Xiami"), health.score("Kugou")) << "Provider Health Score Test Failed";
+
+    // Saved and loaded, with the open duration passed so a single probe is let through
+    auto path = std::filesystem::temp_directory_path() / "CLyricProviderHealthTest.stats";
+    {
+        EXPECT_FALSE(health.save()) << "Provider Health Save Test Failed";
+        CLyricProviderHealth saved;
+        saved.open(path.u8string());
+        for (int i = 0; i < CLyricProviderHealth::failureThreshold; ++i)
+            saved.recordResult("Xiami", false, std::chrono::milliseconds(10000));
+        saved.recordResult("Netease", true, std::chrono::milliseconds(300));
+        ASSERT_TRUE(saved.save()) << "Provider Health Save Test Failed";
+    }
+    std::string contents;
+    {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        contents = buffer.str();
+    }
+    const std::string prefix = "Xiami 3 0 0 3 "; // attempts, successes, chosen and failures before openUntil
+    size_t openUntil = contents.find(prefix);
+    ASSERT_NE(openUntil, std::string::npos) << "Provider Health Save Test Failed";
+    openUntil += prefix.size();
+    contents.replace(openUntil, contents.find(' ', openUntil) - openUntil, "0");
+    std::ofstream(path) << contents;
+
+    CLyricProviderHealth loaded;
+    ASSERT_TRUE(loaded.open(path.u8string())) << "Provider Health Load Test Failed";
+    EXPECT_EQ(loaded.statistics("Netease").latencies, std::vector<int>{300}) << "Provider Health Load Test Failed";
+    EXPECT_TRUE(loaded.allowRequest("Xiami")) << "Provider Health Probe Test Failed";
+    EXPECT_FALSE(loaded.allowRequest("Xiami")) << "Provider Health Probe Test Failed";
+    loaded.recordResult("Xiami", false, std::chrono::milliseconds(10000));
+    EXPECT_EQ(loaded.statistics("Xiami").openDuration, 2 * 5 * 60) << "Provider Health Backoff Test Failed";
+    EXPECT_FALSE(loaded.allowRequest("Xiami")) << "Provider Health Backoff Test Failed";
+    std::filesystem::remove(path);
+
+    // A search which sends no request is not measured. THBWiki has none to search, and with the circuits of
+    // the others open and the deadline passed nothing goes over the network.
+    CLyricProviderHealth &shared = CLyricProviderHealth::instance();
+    shared.open(path.u8string());
+    for (const char *name: {"Xiami", "Netease", "QQMusic", "Kugou", "Gecimi"}) {
+        for (int i = 0; i < CLyricProviderHealth::failureThreshold; ++i)
+            shared.recordResult(name, false, std::chrono::milliseconds(10000));
+    }
+    CLyricSearch(CLyricCancellation(CLyricCancellation::Clock::duration::zero())).searchCLyric("Title", "Artist", 200);
+    EXPECT_EQ(shared.statistics("THBWiki").attempts, 0) << "Provider Health Unsent Request Test Failed";
+    shared.open("");
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,81 @@
+//
+// Created by datasone.
+// This file is part of CrystalLyrics.
+//
+
+#include "../CLyricLibrary.h"
+#include "../CLyricBinary.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace cLyric;
+
+namespace {
+
+    void printUsage(const char *program) {
+        std::fprintf(stderr, "Usage: %s <directory> [--threads N] [--rebuild-cache] [--verbose]\n"
+                             "Loads and validates all .clrc files in the directory.\n"
+                             "  --threads N      Number of worker threads, defaults to all cores\n"
+                             "  --rebuild-cache  Rewrite the .clrcb cache of every parsed file\n"
+                             "  --verbose        Print every file instead of only the broken ones\n", program);
+    }
+
+}
+
+int main(int argc, char *argv[]) {
+    std::string directory;
+    unsigned threadCount = 0;
+    bool rebuildCache = false, verbose = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--rebuild-cache") == 0) {
+            rebuildCache = true;
+        } else if (std::strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (directory.empty() && argv[i][0] != '-') {
+            directory = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (directory.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    CLyricLibrary::EntryCallback callback;
+    if (rebuildCache) {
+        callback = [](const CLyricLibraryEntry &entry, const CLyric &lyric) {
+            if (entry.valid)
+                saveBinaryCache(lyric, entry.path);
+        };
+    }
+
+    std::vector<CLyricLibraryEntry> entries;
+    CLyricLibraryStats stats = CLyricLibrary(directory).load(entries, callback, threadCount);
+
+    for (const CLyricLibraryEntry &entry: entries) {
+        if (!entry.error.empty()) {
+            std::printf("ERROR    %s: %s\n", entry.path.c_str(), entry.error.c_str());
+        } else if (!entry.valid) {
+            std::printf("INVALID  %s\n", entry.path.c_str());
+        } else if (verbose) {
+            std::printf("OK       %s\n", entry.path.c_str());
+        }
+    }
+
+    std::printf("%zu files (%zu valid, %zu invalid, %zu errors), %.2f MiB in %.3f s on %u threads: "
+                "%.0f files/s, %.2f MiB/s\n",
+                stats.files, stats.validFiles, stats.invalidFiles, stats.failedFiles,
+                double(stats.bytes) / (1024 * 1024), stats.seconds, stats.threads,
+                stats.filesPerSecond(), stats.megabytesPerSecond());
+
+    return (stats.invalidFiles == 0 && stats.failedFiles == 0) ? 0 : 1;
+}
@@ -10,6 +10,8 @@
 #include "CLyricLabel.h"
 #include "ui-qt/utils.h"
 #include "MainApplication.h"
+#include "CLyricUtils.h"
+#include <QTextLayout>
 
 // TODO: Font Shadow
 
@@ -19,24 +21,50 @@ CLyricLabel::CLyricLabel(const QFont &font, QColor color, QColor playedColor, CL
           firstLine(firstLine) {
     if (item->translation.empty()) text = QString::fromStdString(item->content);
     text = QString::fromStdString(firstLine ? item->content : item->translation);
-    hasTimeCode = !(item->timecodes.empty());
 
     metrics = QFontMetricsF(font);
-    if (hasTimeCode) {
-        for (const auto &timecode : item->timecodes) {
-            pixelMap.append(QPair<int, int>(
-                    timecode.first,
-                    metrics.horizontalAdvance(text, timecode == item->timecodes.back() ? -1 : timecode.second)
-            ));
-        }
-    }
+    prepareKaraoke();
 
     fillTimer = new QTimer(this);
-    segmentTimer = new QTimer(this);
-    segmentTimer->setSingleShot(true);
-
     connect(fillTimer, &QTimer::timeout, this, &CLyricLabel::fill);
-    connect(segmentTimer, &QTimer::timeout, this, [=]() { startFill(segmentIndex, 0); });
+}
+
+void CLyricLabel::prepareKaraoke() {
+    // Only the first line is filled
+    hasTimeCode = false;
+    karaokeCursor = CLyricKaraokeCursor();
+    if (!firstLine || item->timecodes.empty())
+        return;
+
+    // One layout pass gives the x of every char boundary
+    QTextLayout layout(text, font);
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    layout.endLayout();
+
+    // Only the char counts the timecodes end at are measured. They come in increasing order, so the byte offset
+    // and the UTF-16 index move forward from the last boundary, code points past the BMP take two units.
+    std::string utf8Text = text.toStdString();
+    size_t lastChars = 0, byteOffset = 0;
+    int textIndex = 0;
+    auto charPosition = [&](size_t chars) {
+        if (chars < lastChars)
+            lastChars = byteOffset = textIndex = 0;
+        std::string_view rest = std::string_view(utf8Text).substr(byteOffset);
+        size_t bytes = utf8CharsToBytes(rest, chars - lastChars);
+        textIndex += static_cast<int>(chars - lastChars);
+        for (size_t i = 0; i < bytes; ++i)
+            textIndex += static_cast<unsigned char>(rest[i]) >= 0xF0u;
+        byteOffset += bytes;
+        lastChars = chars;
+        return line.isValid() ? line.cursorToX(textIndex) : 0.0;
+    };
+
+    karaokeCursor = CLyricKaraokeCursor(item->timecodes, utf8StringChars(utf8Text), charPosition);
+    hasTimeCode = !karaokeCursor.empty();
 }
 
 void CLyricLabel::paintEvent([[maybe_unused]] QPaintEvent *event) {
@@ -58,44 +86,29 @@ void CLyricLabel::paintEvent([[maybe_unused]] QPaintEvent *event) {
     }
 }
 
-void CLyricLabel::startFill(int currentSegmentIndex, int currentTimeInSegment) {
-    segmentIndex = currentSegmentIndex;
-
+void CLyricLabel::startFill(int timeInLine) {
     fillTimer->stop();
     if (!firstLine || !hasTimeCode) {
         update();
         return;
     }
 
-    if (segmentIndex >= pixelMap.size())
-        return;
-
-    if (maskWidthInterval < 0 && segmentIndex > 0) {
-        const int timeInterval = pixelMap[segmentIndex].first - pixelMap[segmentIndex - 1].first;
-        const int pixelInterval = pixelMap[segmentIndex].second - pixelMap[segmentIndex - 1].second;
-
-        maskWidthInterval = pixelInterval * 16.0 / timeInterval;
-    }
-
-    maskWidth = pixelMap[segmentIndex].second + currentTimeInSegment / 16.0 * maskWidthInterval;
+    fillStartTime = timeInLine;
+    fillClock.start();
+    maskWidth = karaokeCursor.position(timeInLine);
     update();
 
-    if (++segmentIndex == pixelMap.size()) return;
-
-    const int timeInterval = pixelMap[segmentIndex].first - pixelMap[segmentIndex - 1].first;
-    const int pixelInterval = pixelMap[segmentIndex].second - pixelMap[segmentIndex - 1].second;
-
-    maskWidthInterval = pixelInterval * 16.0 / timeInterval;
-
-    fillTimer->start(16);
-
-    segmentTimer->setInterval(timeInterval - currentTimeInSegment);
-    segmentTimer->start();
+    if (timeInLine < karaokeCursor.endTime())
+        fillTimer->start(16);
 }
 
 void CLyricLabel::fill() {
-    maskWidth += maskWidthInterval;
+    const int time = fillStartTime + static_cast<int>(fillClock.elapsed());
+    maskWidth = karaokeCursor.position(time);
     update();
+
+    if (time >= karaokeCursor.endTime())
+        fillTimer->stop();
 }
 
 void CLyricLabel::updateLyric(CLyricItem *newItem, bool isFirstLine, bool convertTCSC) {
@@ -105,8 +118,6 @@ void CLyricLabel::updateLyric(CLyricItem *newItem, bool isFirstLine, bool conver
     } else {
         item = newItem;
         maskWidth = 0;
-        maskWidthInterval = -1;
-        pixelMap.clear();
 
         text = QString::fromStdString(isFirstLine ? item->content : item->translation);
 
@@ -114,32 +125,17 @@ void CLyricLabel::updateLyric(CLyricItem *newItem, bool isFirstLine, bool conver
             text = QString::fromStdString(MainApplication::openCCSimpleConverter.Convert(text.toStdString()));
         }
 
-        hasTimeCode = !(item->timecodes.empty());
-
+        prepareKaraoke();
         if (hasTimeCode) {
-            for (const auto &timecode: item->timecodes) {
-                pixelMap.append(QPair<int, int>(timecode.first,
-                                      metrics.horizontalAdvance(text,
-                                                                timecode == item->timecodes.back() ? -1
-                                                                                                   : timecode.second)));
-            }
             updateTime(0);
+        } else {
+            fillTimer->stop();
         }
     }
     update();
 }
 
 void CLyricLabel::updateTime(int timeInMs) {
-    int timeInSegment = -1;
-    if (hasTimeCode) {
-        for (size_t i = 0; i < item->timecodes.size() - 2;) {
-            if (item->timecodes[++i].first > timeInMs) {
-                segmentIndex = i - 1;
-                timeInSegment = timeInMs - item->timecodes[segmentIndex].first;
-                break;
-            }
-        }
-        if (timeInSegment >= 0)
-            startFill(segmentIndex, timeInSegment);
-    }
-}
\ No newline at end of file
+    if (hasTimeCode)
+        startFill(timeInMs);
+}
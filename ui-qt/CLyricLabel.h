@@ -9,9 +9,12 @@
 #include <QLabel>
 #include <QtCore/QPair>
 #include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
 #include "CLyric.h"
+#include "CLyricKaraoke.h"
 
 using cLyric::CLyricItem;
+using cLyric::CLyricKaraokeCursor;
 
 class CLyricLabel : public QLabel {
 Q_OBJECT
@@ -26,10 +29,13 @@ private:
     QColor color, playedColor;
     CLyricItem *item;
     bool firstLine, hasTimeCode = false;
-    QList<QPair<int, int>> pixelMap; // QList<QPair<ms, pixels>>
-    int segmentIndex = 0, currentTimeInSegment = 0;
-    double maskWidth = 0, maskWidthInterval = -1;
-    QTimer *fillTimer, *segmentTimer;
+    CLyricKaraokeCursor karaokeCursor;
+    QElapsedTimer fillClock;
+    int fillStartTime = 0;
+    double maskWidth = 0;
+    QTimer *fillTimer;
+
+    void prepareKaraoke();
 
 public slots:
 
@@ -39,7 +45,7 @@ public slots:
 
 private slots:
 
-    void startFill(int segmentIndex, int currentTimeInSegment = 0);
+    void startFill(int timeInLine);
 
     void fill();
 
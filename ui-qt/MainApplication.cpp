@@ -6,9 +6,15 @@
 #include "MainApplication.h"
 #include "utils.h"
 
+#include <CLyric/CLyricNegativeCache.h>
+#include <CLyric/CLyricProviderHealth.h>
+#include <CLyric/CLyricResponseCache.h>
 #include <CLyric/CLyricSearch.h>
+#include <CLyric/CLyricUtils.h>
 
+#include <chrono>
 #include <thread>
+#include <algorithm>
 #include <QApplication>
 #include <QScreen>
 #include <QDir>
@@ -36,8 +42,14 @@ QString path = QCoreApplication::applicationDirPath();
 #endif
 
 using cLyric::CLyricSearch;
+using cLyric::CLyricResponseCache;
+using cLyric::CLyricNegativeCache;
+using cLyric::CLyricProviderHealth;
 using cLyric::LyricStyle;
 
+// Time a track search may take before it settles for the lyrics found so far
+constexpr std::chrono::seconds searchBudget(8);
+
 opencc::SimpleConverter MainApplication::openCCSimpleConverter =
         opencc::SimpleConverter(path.toStdString() + "opencc-files/t2s.json");
 
@@ -46,6 +58,8 @@ MainApplication::MainApplication() {
 
     if (!QDir().exists(appDataPath))
         QDir().mkpath(appDataPath);
+    CLyricResponseCache::instance().open(appDataPath.toStdString() + "/ResponseCache");
+    CLyricProviderHealth::instance().open(appDataPath.toStdString() + "/ProviderHealth.stats");
 
     qRegisterMetaType<CLyric>("CLyric");
     qRegisterMetaType<std::vector<CLyric>>("std::vector<CLyric>");
@@ -150,6 +164,9 @@ void MainApplication::showLyricsWindow() {
 }
 
 void MainApplication::showSearchWindow() {
+    // A manual search means the track has lyrics after all, let the next play search it again
+    if (!appDataPath.isEmpty())
+        CLyricNegativeCache(appDataPath.toStdString()).remove(currentTrack);
     if (searchWindow == nullptr) {
         searchWindow = new SearchWindow(currentTrack.title, currentTrack.artist, currentTrack.duration, this,
                                         nullptr);
@@ -247,8 +264,10 @@ void MainApplication::parseSocketResult(QLocalSocket *socket) {
             lyricsWindow->clearLyrics();
 
         pcLyric = nullptr;
-        std::thread thread([this] {
-            findLyric(currentTrack.title, currentTrack.album, currentTrack.artist, currentTrack.duration);
+        searchCancellation.cancel();
+        searchCancellation = CLyricCancellation(searchBudget);
+        std::thread thread([this, track = currentTrack, cancellation = searchCancellation] {
+            findLyric(track.title, track.album, track.artist, track.duration, cancellation);
         });
         thread.detach();
     } else if (task == "setState") {
@@ -258,6 +277,7 @@ void MainApplication::parseSocketResult(QLocalSocket *socket) {
     } else if (task == "setQuit") {
         const bool quit = parameters["quit"] == "true";
         if (quit) {
+            searchCancellation.cancel();
             desktopLyricsWindow->hide();
             desktopLyricsWindow->clearLyrics();
             currentTrack = Track();
@@ -291,9 +311,10 @@ void MainApplication::timerTimeout() {
     if (lyricsWindow)
         lyricsWindow->activateLine(currentLine);
 
-    if (currentLine < static_cast<int>(pcLyric->lyrics.size()) - 1) {
-        nextLyric = &(pcLyric->lyrics[currentLine + 1]);
-        timer->setInterval(nextLyric->startTime - currentLyric->startTime);
+    if (currentLine + 1 < static_cast<int>(timeline.size())) {
+        // Scheduled against the playback position, so timer latency does not add up over lines
+        const int position = elapsedTime + static_cast<int>(eTimer->elapsed());
+        timer->setInterval(std::max(0, timeline.startTime(currentLine + 1) - position));
         timer->start();
     }
 }
@@ -335,6 +356,7 @@ void MainApplication::updateLyric(const CLyric &lyric, bool manualSearch) {
     currentTrack.instrumental = cLyric.track.instrumental;
 
     offset = cLyric.offset;
+    timeline = CLyricTimeline(cLyric);
 
     if (cLyric.track.source != "LocalFile") {
         cLyric.track = currentTrack;
@@ -395,35 +417,28 @@ void MainApplication::updateTime(int position, bool playing) {
     elapsedTime = position;
     eTimer->start();
 
-    if (pcLyric->lyrics.size() == 1) {
-        currentLine = 0;
-        if (desktopLyricsWindow)
-            desktopLyricsWindow->setLine(currentLine, position - pcLyric->lyrics[currentLine].startTime - offset);
-        if (lyricsWindow)
-            lyricsWindow->activateLine(currentLine);
-        return;
-    }
-
-    for (size_t i = 0; i < pcLyric->lyrics.size() - 2;) {
-        if (pcLyric->lyrics[++i].startTime + offset > position) {
-            currentLine = i - 1;
-            timer->setInterval(pcLyric->lyrics[i].startTime + offset - position);
-            timer->start();
-            if (desktopLyricsWindow)
-                desktopLyricsWindow->setLine(currentLine, position - pcLyric->lyrics[currentLine].startTime - offset);
-            if (lyricsWindow)
-                lyricsWindow->activateLine(currentLine);
-            break;
-        }
+    const CLyricTimeline::Position current = timeline.seek(position);
+    currentLine = current.line;
+    if (current.nextEventIn >= 0) {
+        timer->setInterval(current.nextEventIn);
+        timer->start();
+    } else {
+        timer->stop();
     }
-
+    if (desktopLyricsWindow)
+        desktopLyricsWindow->setLine(currentLine, current.timeInLine);
+    if (lyricsWindow)
+        lyricsWindow->activateLine(currentLine);
 }
 
 void MainApplication::findLyric(const std::string &title, const std::string &album, const std::string &artist,
-                                int duration) {
+                                int duration, const CLyricCancellation &cancellation) {
     if (appDataPath.isEmpty())
         return;
-    CLyric lyric = CLyricSearch().fetchCLyric(title, album, artist, duration, appDataPath.toStdString());
+    CLyric lyric = CLyricSearch(cancellation).fetchCLyric(title, album, artist, duration, appDataPath.toStdString());
+    // The track changed meanwhile, its search has been superseded
+    if (cancellation.isCancelled())
+        return;
     if (lyric.isValid()) {
         emit lyricFound(lyric, false);
     } else {
@@ -463,31 +478,6 @@ void MainApplication::wrongLyric() {
     pcLyric = nullptr;
 }
 
-namespace {
-    inline std::string normalizeFileName(std::string name) {
-        for (auto &c: name) {
-            if (static_cast<unsigned char>(c) > 127) {
-                // Non-Ascii char
-                continue;
-            }
-            switch (c) {
-                case '/':
-                case '\\':
-                case '?':
-                case '%':
-                case '*':
-                case ':':
-                case '|':
-                case '"':
-                case '<':
-                case '>':
-                    c = ' ';
-            }
-        }
-        return name;
-    }
-}
-
 void MainApplication::setTrackInstrumental() {
     if (currentTrack.duration > 0) {
         currentTrack.instrumental = true;
@@ -638,6 +628,7 @@ int MainApplication::currentScreenIndex() {
 
 void MainApplication::updateLyricOffset(int offset) {
     this->offset = int(offset);
+    timeline.setOffset(this->offset);
     updateTime(-1, isPlaying);
 }
 
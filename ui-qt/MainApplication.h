@@ -14,6 +14,8 @@
 #include "OffsetWindow.h"
 
 #include <CLyric/CLyric.h>
+#include <CLyric/CLyricCancellation.h>
+#include <CLyric/CLyricTimeline.h>
 #include <QtWidgets/QSystemTrayIcon>
 #include <QtWidgets/QMenu>
 #include <QtGui/QAction>
@@ -27,6 +29,8 @@
 #include <QWidgetAction>
 
 using cLyric::CLyric;
+using cLyric::CLyricCancellation;
+using cLyric::CLyricTimeline;
 using cLyric::Track;
 
 class MainApplication : public QObject {
@@ -135,12 +139,16 @@ private:
     QPointer<OffsetWindow> offsetWindow = nullptr;
 
     CLyric cLyric;
+    CLyricTimeline timeline;
     CLyricItem *currentLyric = nullptr, *nextLyric = nullptr;
     QElapsedTimer *eTimer;
     QTimer *timer;
     int elapsedTime = -1;
     int offset = 0;
 
+    // Search of the current track, cancelled when the track changes
+    CLyricCancellation searchCancellation;
+
     bool conversionTCSC;
 
     QString appDataPath;
@@ -157,7 +165,8 @@ private:
 
     void resume();
 
-    void findLyric(const std::string &title, const std::string &album, const std::string &artist, int duration);
+    void findLyric(const std::string &title, const std::string &album, const std::string &artist, int duration,
+                   const CLyricCancellation &cancellation);
 };
 
 
@@ -7,7 +7,7 @@
 #include <QTimer>
 #include <QNetworkReply>
 #include <CLyric/CLyricSearch.h>
-#include <CLyric/CLyricUtils.h>
+#include <CLyric/CLyricRanker.h>
 
 #include "CLyric.h"
 #include "MainApplication.h"
@@ -15,6 +15,7 @@
 #include "ui_SearchWindow.h"
 
 using cLyric::CLyricSearch;
+using cLyric::CLyricRanker;
 
 SearchWindow::SearchWindow(const std::string &title, const std::string &artist, int duration, MainApplication *mainApp,
                            QWidget *parent)
@@ -71,35 +72,7 @@ void SearchWindow::searchLyrics() {
 
         auto lyrics = CLyricSearch().searchCLyric(title, artist, duration);
 
-        std::stable_sort(lyrics.begin(), lyrics.end(),
-                         [&](const CLyric &res1, const CLyric &res2) {
-                             int length = title.size() + artist.size() / 2;
-                             int distance1 =
-                                     stringDistance(res1.track.title, title) +
-                                     stringDistance(res1.track.artist, artist) / 2;
-                             int distance2 =
-                                     stringDistance(res2.track.title, title) +
-                                     stringDistance(res2.track.artist, artist) / 2;
-                             double score1 = 1 - double(distance1) / length;
-                             double score2 = 1 - double(distance2) / length;
-                             if (std::any_of(res1.lyrics.begin(), res1.lyrics.end(),
-                                             [](CLyricItem item) { return !item.translation.empty(); }))
-                                 score1 += 0.2;
-                             if (std::any_of(res2.lyrics.begin(), res2.lyrics.end(),
-                                             [](CLyricItem item) { return !item.translation.empty(); }))
-                                 score2 += 0.2;
-                             if (std::any_of(res1.lyrics.begin(), res1.lyrics.end(),
-                                             [](CLyricItem item) { return !item.timecodes.empty(); }))
-                                 score1 += 0.1;
-                             if (std::any_of(res2.lyrics.begin(), res2.lyrics.end(),
-                                             [](CLyricItem item) { return !item.timecodes.empty(); }))
-                                 score2 += 0.1;
-                             if (!res1.isValid())
-                                 score1 -= 1;
-                             if (!res2.isValid())
-                                 score2 -= 1;
-                             return score1 > score2;
-                         });
+        CLyricRanker(title, artist, duration).rank(lyrics);
 
         if (searchWindow)
                 emit searchResultSignal(std::move(lyrics));